@@ -19,12 +19,38 @@ VERSION = 0.0
 
 SOURCES += \
     ../src/msdp2xxx_low.c \
-    ../src/msdp2xxx.c
+    ../src/msdp2xxx.c \
+    ../src/msdp2xxx_loop.c \
+    ../src/msdp2xxx_async.c \
+    ../src/msdp2xxx_mt.c \
+    ../src/msdp2xxx_uring.c \
+    ../src/msdp2xxx_msdpd.c \
+    ../src/msdp2xxx_coal.c \
+    ../src/msdp2xxx_shm.c \
+    ../src/msdp2xxx_sched.c \
+    ../src/msdp2xxx_poll.c \
+    ../src/msdp2xxx_adapt.c \
+    ../src/msdp2xxx_disc.c \
+    ../src/msdp2xxx_lease.c \
+    ../src/msdp2xxx_mirror.c
 
 HEADERS += \
     ../src/include/msdp2xxx_low.h \
     ../src/include/msdp2xxx_base.h \
-    ../src/include/msdp2xxx.h
+    ../src/include/msdp2xxx.h \
+    ../src/include/msdp2xxx_loop.h \
+    ../src/include/msdp2xxx_async.h \
+    ../src/include/msdp2xxx_mt.h \
+    ../src/include/msdp2xxx_uring.h \
+    ../src/include/msdp2xxx_msdpd.h \
+    ../src/include/msdp2xxx_coal.h \
+    ../src/include/msdp2xxx_shm.h \
+    ../src/include/msdp2xxx_sched.h \
+    ../src/include/msdp2xxx_poll.h \
+    ../src/include/msdp2xxx_adapt.h \
+    ../src/include/msdp2xxx_disc.h \
+    ../src/include/msdp2xxx_lease.h \
+    ../src/include/msdp2xxx_mirror.h
 
 unix:!symbian {
     maemo5 {
@@ -29,11 +29,213 @@
 #define __MSDP2XXX_H___
 
 #include "msdp2xxx_base.h"
+#include "msdp2xxx_low.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/** Minimal margin added to estimated round trip time [us], covers latency
+ * timer of USB serial converters (16 ms by default). */
+#define SDP_RTT_MARGIN (20000l)
+
+/**
+ * Round trip time estimator of one command, smoothed RTT and its variation
+ *      are updated as in TCP (RFC 6298) and used to set response timeout.
+ */
+typedef struct {
+        /** smoothed round trip time [us] */
+        long srtt;
+        /** round trip time variation [us] */
+        long rttvar;
+        /** number of succesfull exchanges used to estimate RTT */
+        unsigned long samples;
+        /** number of exchanges failed on timeout */
+        unsigned long timeouts;
+} sdp_rtt_t;
+
+/**
+ * State of circuit breaker.
+ */
+typedef enum {
+        /** device responds, requests are send */
+        sdp_breaker_closed = 0,
+        /** device does not respond, requests fail fast with SDP_EDEVDOWN */
+        sdp_breaker_open,
+        /** backoff expired, device is probed */
+        sdp_breaker_half_open,
+} sdp_breaker_state_t;
+
+/**
+ * Circuit breaker of one device address. After threshold consecutive
+ *      timeouts or invalid responses breaker opens and requests fail
+ *      without waiting for timeout. When backoff expires device is probed
+ *      by GCOM, success closes breaker, failure opens it again with doubled
+ *      backoff.
+ */
+typedef struct {
+        /** number of consecutive failures which opens breaker,
+         * 0 when breaker is disabled */
+        int threshold;
+        /** first and longest backoff [us] */
+        long backoff_min;
+        long backoff_max;
+        /** current state */
+        sdp_breaker_state_t state;
+        /** number of consecutive failures */
+        int fails;
+        /** current backoff [us] */
+        long backoff;
+        /** time device might be probed again [us] */
+        long long retry;
+        /** time of last change of state [us] */
+        long long changed;
+        /** number of transitions to open and closed state */
+        unsigned long opens;
+        unsigned long closes;
+        /** number of requests rejected without exchange */
+        unsigned long rejects;
+        /** number of probes */
+        unsigned long probes;
+} sdp_breaker_t;
+
+/**
+ * Setpoint shadow, last voltage and current setpoint acknowledged by each
+ *      device. Setpoint write of value device already holds is not send,
+ *      see sdp_set_shadow.
+ */
+typedef struct {
+        /** 1 when writes are elided and coalesced */
+        int enabled;
+        /** last acknowledged VOLT and CURR value as encoded in command,
+         * -1 when not known */
+        int volt[SDP_DEV_ADDR_MAX + 1];
+        int curr[SDP_DEV_ADDR_MAX + 1];
+        /** number of writes not send because device holds the value */
+        unsigned long elided;
+        /** number of queued writes replaced by newer write of the same
+         * setpoint before they were send */
+        unsigned long coalesced;
+} sdp_shadow_t;
+
+/** Number of cached reads (GCOM, GMAX, GOVP) of one device. */
+#define SDP_CACHE_OPS 3
+
+/**
+ * Cached response of one read.
+ */
+typedef struct {
+        /** lenght of response, 0 when entry is not valid */
+        int len;
+        /** time response was recieved [us] */
+        long long stamp;
+        char resp[SDP_BUF_SIZE_MIN];
+} sdp_cache_entry_t;
+
+/**
+ * Cache of reads which values change only by commands of this library
+ *      (device address, maximums, voltage limit), see sdp_set_cache.
+ */
+typedef struct {
+        /** 1 when reads are served from cache */
+        int enabled;
+        /** time response stays valid [us], 0 for unlimited */
+        long ttl;
+        /** cached responses indexed by device address and read */
+        sdp_cache_entry_t entry[SDP_DEV_ADDR_MAX + 1][SDP_CACHE_OPS];
+        /** number of reads served from cache and send to device */
+        unsigned long hits;
+        unsigned long misses;
+} sdp_cache_t;
+
+/**
+ * Time one part of snapshot was read, sdp_time_us values.
+ */
+typedef struct {
+        /** time command was issued [us] */
+        long long sent;
+        /** time response was recieved [us] */
+        long long recv;
+} sdp_snapshot_time_t;
+
+/**
+ * Measured values, setpoints and panel state of device read at once by
+ *      sdp_snapshot.
+ */
+typedef struct {
+        /** mask of SDP_FIELD_* values which are valid */
+        unsigned int valid;
+        /** SDP_FIELD_VA_DATA fields */
+        sdp_va_data_t va_data;
+        /** SDP_FIELD_SETPOINT fields */
+        sdp_va_t va_setpoints;
+        /** SDP_FIELD_LCD_INFO fields */
+        sdp_lcd_info_t lcd_info;
+        /** time each part was read, valid when anny of its fields is */
+        sdp_snapshot_time_t va_data_time;
+        sdp_snapshot_time_t va_setpoints_time;
+        sdp_snapshot_time_t lcd_info_time;
+} sdp_snapshot_t;
+
+/** Set low latency mode of serial port driver, reduces delay of recieved
+ * data in USB serial converters (Linux ASYNC_LOW_LATENCY). */
+#define SDP_OPEN_LOW_LATENCY    (1 << 0)
+/** Drop stale data waiting in input buffer of serial port. */
+#define SDP_OPEN_FLUSH          (1 << 1)
+/** Open serial port for exclusive access (Linux TIOCEXCL). */
+#define SDP_OPEN_EXCL           (1 << 2)
+/** Exchange data by io_uring instead of wait method, Linux only. When
+ * io_uring is not available, wait method is used. */
+#define SDP_OPEN_URING          (1 << 3)
+
+/**
+ * Method used to wait for response from device.
+ */
+typedef enum {
+        /** wait by select() */
+        sdp_wait_select = 0,
+        /** wait by poll() */
+        sdp_wait_poll,
+        /** wait by edge triggered epoll, Linux only */
+        sdp_wait_epoll,
+        /** blocking read() with timeout in VTIME, no separate wait,
+         * timeout granularity is 100 ms, Linux only */
+        sdp_wait_vmin,
+} sdp_wait_t;
+
+/**
+ * Statistics of comunication, used to compare wait methods.
+ */
+typedef struct {
+        /** number of returns from blocking system calls */
+        unsigned long wakeups;
+        /** number of system calls spent on comunication */
+        unsigned long syscalls;
+        /** number of recieved responses */
+        unsigned long frames;
+} sdp_io_stats_t;
+
+struct sdp_uring;
+
+/**
+ * Options of sdp_open_ex.
+ */
+typedef struct {
+        /** requested options, bitmask of SDP_OPEN_* flags */
+        unsigned int flags;
+        /** method used to wait for response */
+        sdp_wait_t wait;
+        /** options which system accepted, set by sdp_open_ex */
+        unsigned int accepted;
+        /** io_uring shared with other ports, used with SDP_OPEN_URING,
+         * NULL means private io_uring of this port */
+        struct sdp_uring *uring;
+} sdp_open_opts_t;
+
+struct sdp_mt;
+struct sdp_coal;
+struct sdp_shm;
+
 /**
  * SDP device structure.
  */
@@ -44,37 +246,188 @@ typedef struct {
         SDP_F f_in;
         /** SDP device output file handler, normaly f_in == f_out. */
         SDP_F f_out;
+        /** Method used to wait for response, set by sdp_set_wait. */
+        sdp_wait_t wait;
+        /** Private state of wait method. */
+        int wait_fd;
+        int wait_ready;
+        int wait_tio;
+        /** Statistics of comunication. */
+        sdp_io_stats_t io;
+        /** State of thread-safe mode, NULL when not used, see sdp_mt_start. */
+        struct sdp_mt *mt;
+        /** State of read coalescer, NULL when not used, see sdp_coal_start. */
+        struct sdp_coal *coal;
+        /** Attached io_uring, NULL when not used, see sdp_uring_add. */
+        struct sdp_uring *uring;
+        int uring_slot;
+        /** 1 when io_uring is private and released by sdp_close */
+        int uring_own;
+        /** 1 when f_in is connection to msdpd, see sdp_msdpd_open. */
+        int msdpd;
+        /** Sequence number of last request send to msdpd. */
+        unsigned int msdpd_seq;
+        /** Shared memory readings are published to, see sdp_shm_attach. */
+        struct sdp_shm *shm;
+        int shm_slot;
+        /** Number of commands changing state of device (setpoints, output,
+         * presets, ...) send through sdp. */
+        unsigned long changes;
+        /** Framer of responses recieved on f_in. */
+        sdp_rx_t rx;
+        /** Round trip time estimators, indexed by sdp_op_t. */
+        sdp_rtt_t rtt[sdp_op_count];
+        /** Circuit breakers indexed by device address, see
+         * sdp_set_breaker. */
+        sdp_breaker_t breaker[SDP_DEV_ADDR_MAX + 1];
+        /** Capabilities of identified model, NULL when not known, see
+         * sdp_set_model. */
+        const sdp_caps_t *caps;
+        /** Setpoint shadow, see sdp_set_shadow. */
+        sdp_shadow_t shadow;
+        /** Cache of static reads, see sdp_set_cache. */
+        sdp_cache_t cache;
 } sdp_t;
 
+/** Maximal number of commands in one batch. */
+#define SDP_BATCH_MAX (16)
+/** Size of buffer for all responses of one batch. */
+#define SDP_BATCH_RESP_SIZE (2 * SDP_RX_BUF_SIZE)
+
+/**
+ * Batch of commands send to device at once. Commands are prepared by sdp_s*
+ *      functions directly into one continuous buffer and are send by single
+ *      write call. Responses are assigned to commands in order of arrival.
+ */
+typedef struct {
+        /** commands, one behind other, with space for one more command */
+        char cmd[(SDP_BATCH_MAX + 1) * SDP_BUF_SIZE_MIN];
+        /** lenght of all commands in cmd */
+        int cmd_len;
+        /** number of commands in batch */
+        int count;
+        /** first error which occured when adding commands */
+        int err;
+        /** recieved responses, one behind other */
+        char resp[SDP_BATCH_RESP_SIZE];
+        /** offset of response in resp for each command */
+        int resp_off[SDP_BATCH_MAX];
+        /** lenght of response for each command, negative number (error no.)
+         * when response was not recieved */
+        int ret[SDP_BATCH_MAX];
+} sdp_batch_t;
+
+typedef struct sdp_req sdp_req_t;
+
+/**
+ * Callback called when request is completed.
+ * @param req   Completed request, req->ret contains result.
+ */
+typedef void (*sdp_req_cb_t)(sdp_req_t *req);
+
+/**
+ * One command/response exchange with device, used by non-blocking
+ *      interfaces. Command is prepared by one of sdp_s* functions, response
+ *      is parsed by corresponding sdp_resp_* function.
+ */
+struct sdp_req {
+        /** command to send */
+        char cmd[SDP_BUF_SIZE_MIN];
+        /** lenght of command, return value of sdp_s* function */
+        int cmd_len;
+        /** buffer used to store recieved response */
+        char resp[SDP_RX_BUF_SIZE];
+        /** lenght of response on success, negative number (error no.)
+         * on error */
+        int ret;
+        /** value of errno when request failed with SDP_EERRNO */
+        int err;
+        /** callback called on completion, might be NULL */
+        sdp_req_cb_t cb;
+        /** user data, not used by library */
+        void *priv;
+        /** device request is submitted to, set on submit */
+        sdp_t *sdp;
+        /** priority class, set by scheduler on submit */
+        sdp_class_t cls;
+        /** time of submission, used by scheduler [us] */
+        long long queued;
+        /** next request in queue, used internaly */
+        sdp_req_t *next;
+};
+
 /* High leve operation functions */
 #ifdef _WIN32
 int sdp_open(sdp_t *sdp, const wchar_t *fname, int addr);
+int sdp_open_ex(sdp_t *sdp, const wchar_t *fname, int addr,
+                sdp_open_opts_t *opts);
 #else
 int sdp_open(sdp_t *sdp, const char *fname, int addr);
+int sdp_open_ex(sdp_t *sdp, const char *fname, int addr,
+                sdp_open_opts_t *opts);
 #endif
 int sdp_openf(sdp_t *sdp, SDP_F f, int addr);
 void sdp_close(sdp_t *sdp);
+int sdp_set_wait(sdp_t *sdp, sdp_wait_t wait);
+long sdp_resp_timeout(sdp_t *sdp, sdp_op_t op, int count);
+void sdp_rtt_update(sdp_t *sdp, sdp_op_t op, int ret, long rtt);
+int sdp_get_rtt(sdp_t *sdp, sdp_op_t op, sdp_rtt_t *rtt);
+void sdp_breaker_init(sdp_breaker_t *breaker, int threshold, long backoff_min,
+                long backoff_max);
+int sdp_breaker_allow(sdp_breaker_t *breaker);
+void sdp_breaker_update(sdp_breaker_t *breaker, int ret);
+int sdp_set_breaker(sdp_t *sdp, int threshold, long backoff_min,
+                long backoff_max);
+int sdp_get_breaker(sdp_t *sdp, int addr, sdp_breaker_t *breaker);
+int sdp_set_shadow(sdp_t *sdp, int enable);
+int sdp_shadow_check(sdp_t *sdp, const char *buf, int len);
+void sdp_shadow_update(sdp_t *sdp, const char *buf, int len, int ret);
+void sdp_get_shadow_stats(sdp_t *sdp, unsigned long *elided,
+                unsigned long *coalesced);
+int sdp_set_cache(sdp_t *sdp, int enable, long ttl);
+void sdp_cache_invalidate(sdp_t *sdp);
+int sdp_cache_get(sdp_t *sdp, const char *buf, int len, char *resp,
+                int size);
+void sdp_cache_update(sdp_t *sdp, const char *buf, int len,
+                const char *resp, int ret);
+void sdp_get_cache_stats(sdp_t *sdp, unsigned long *hits,
+                unsigned long *misses);
+long long sdp_time_us(void);
+
+int sdp_get_dev_addr(sdp_t *sdp);
+int sdp_probe(sdp_t *sdp, int addr, long timeout);
+int sdp_set_model(sdp_t *sdp, sdp_model_t model);
+int sdp_identify(sdp_t *sdp);
+int sdp_get_va_maximums(sdp_t *sdp, sdp_va_t *va_maximums);
+int sdp_get_volt_limit(sdp_t *sdp, double *volt);
+int sdp_get_va_data(sdp_t *sdp, sdp_va_data_t *va_data);
+int sdp_get_va_setpoint(sdp_t *sdp, sdp_va_t *va_setpoints);
+int sdp_get_preset(sdp_t *sdp, int presn, sdp_va_t *va_preset);
+int sdp_get_program(sdp_t *sdp, int progn, sdp_program_t *program);
+int sdp_get_lcd_info(sdp_t *sdp, sdp_lcd_info_t *lcd_info);
+int sdp_query(sdp_t *sdp, unsigned int fields, sdp_va_data_t *va_data,
+                sdp_va_t *va_setpoints, sdp_lcd_info_t *lcd_info);
+int sdp_snapshot(sdp_t *sdp, unsigned int fields, sdp_snapshot_t *snap);
+int sdp_remote(sdp_t *sdp, int enable);
+int sdp_run_preset(sdp_t *sdp, int preset);
+int sdp_run_program(sdp_t *sdp, int count);
+int sdp_select_ifce(sdp_t *sdp, sdp_ifce_t ifce);
+int sdp_set_curr(sdp_t *sdp, double curr);
+int sdp_set_volt(sdp_t *sdp, double volt);
+int sdp_set_volt_limit(sdp_t *sdp, double volt);
+int sdp_set_output(sdp_t *sdp, int enable);
+int sdp_set_poweron_output(sdp_t *sdp, int presn, int enable);
+int sdp_set_preset(sdp_t *sdp, int presn, const sdp_va_t *va_preset);
+int sdp_set_program(sdp_t *sdp, int progn, const sdp_program_t *program);
+int sdp_stop(sdp_t *sdp);
+
+void sdp_batch_init(sdp_batch_t *batch);
+char *sdp_batch_cmd(sdp_batch_t *batch);
+int sdp_batch_add(sdp_batch_t *batch, int len);
+int sdp_batch_run(sdp_t *sdp, sdp_batch_t *batch);
+int sdp_batch_resp(sdp_batch_t *batch, int idx, char **buf);
 
-int sdp_get_dev_addr(const sdp_t *sdp);
-int sdp_get_va_maximums(const sdp_t *sdp, sdp_va_t *va_maximums);
-int sdp_get_volt_limit(const sdp_t *sdp, double *volt);
-int sdp_get_va_data(const sdp_t *sdp, sdp_va_data_t *va_data);
-int sdp_get_va_setpoint(const sdp_t *sdp, sdp_va_t *va_setpoints);
-int sdp_get_preset(const sdp_t *sdp, int presn, sdp_va_t *va_preset);
-int sdp_get_program(const sdp_t *sdp, int progn, sdp_program_t *program);
-int sdp_get_lcd_info(const sdp_t *sdp, sdp_lcd_info_t *lcd_info);
-int sdp_remote(const sdp_t *sdp, int enable);
-int sdp_run_preset(const sdp_t *sdp, int preset);
-int sdp_run_program(const sdp_t *sdp, int count);
-int sdp_select_ifce(const sdp_t *sdp, sdp_ifce_t ifce);
-int sdp_set_curr(const sdp_t *sdp, double curr);
-int sdp_set_volt(const sdp_t *sdp, double volt);
-int sdp_set_volt_limit(const sdp_t *sdp, double volt);
-int sdp_set_output(const sdp_t *sdp, int enable);
-int sdp_set_poweron_output(const sdp_t *sdp, int presn, int enable);
-int sdp_set_preset(const sdp_t *sdp, int presn, const sdp_va_t *va_preset);
-int sdp_set_program(const sdp_t *sdp, int progn, const sdp_program_t *program);
-int sdp_stop(const sdp_t *sdp);
+int sdp_req_run(sdp_t *sdp, sdp_req_t *req);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,77 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_ADAPT_H___
+#define __MSDP2XXX_ADAPT_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Adaptive poller of measured values. While readings stay within deadband
+ *      around reference reading, polling period is doubled after each poll
+ *      up to max. Change of voltage or current out of deadband, flip of
+ *      CC/CV mode or command changing state of device send through the same
+ *      sdp_t (see sdp_t.changes) returns period back to min.
+ */
+typedef struct {
+        /** polled device */
+        sdp_t *sdp;
+        /** fastest and slowest polling period [us] */
+        long min;
+        long max;
+        /** deadband of voltage [V] and current [A] */
+        double dvolt;
+        double dcurr;
+        /** current polling period [us] */
+        long period;
+        /** time next poll is due [us] */
+        long long due;
+        /** value of sdp->changes seen by last poll */
+        unsigned long changes;
+        /** 1 when ref contains valid reading */
+        int valid;
+        /** reading changes are compared to */
+        sdp_va_data_t ref;
+        /** number of polls */
+        unsigned long polls;
+        /** number of returns to fast rate */
+        unsigned long snaps;
+} sdp_adapt_t;
+
+void sdp_adapt_init(sdp_adapt_t *adapt, sdp_t *sdp, long min, long max,
+                double dvolt, double dcurr);
+int sdp_adapt_poll(sdp_adapt_t *adapt, sdp_va_data_t *va_data, long *wait);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_ASYNC_H___
+#define __MSDP2XXX_ASYNC_H___
+
+#include "msdp2xxx_loop.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+typedef struct sdp_async_req sdp_async_req_t;
+
+/**
+ * Result of asynchronously submited operation.
+ */
+typedef struct {
+        /** ticket returned by sdp_submit_* function */
+        int ticket;
+        /** 0 on success, negative number (error no.) on error */
+        int ret;
+        /** value of errno when operation failed with SDP_EERRNO */
+        int err;
+} sdp_completion_t;
+
+/**
+ * Asynchronous interface. Operations are submited by sdp_submit_* functions
+ *      which return immediately with ticket, results are collected from
+ *      completion queue by sdp_poll_completions or sdp_wait.
+ */
+typedef struct {
+        /** event loop driving registered devices */
+        sdp_loop_t loop;
+        /** last assigned ticket */
+        int ticket;
+        /** first item in completion queue */
+        sdp_async_req_t *cq_head;
+        /** last item in completion queue */
+        sdp_async_req_t *cq_tail;
+} sdp_async_t;
+
+int sdp_async_init(sdp_async_t *async);
+void sdp_async_close(sdp_async_t *async);
+int sdp_async_add(sdp_async_t *async, sdp_t *sdp);
+int sdp_async_del(sdp_async_t *async, sdp_t *sdp);
+
+int sdp_poll_completions(sdp_async_t *async, sdp_completion_t *comp, int max);
+int sdp_wait(sdp_async_t *async, int ticket, sdp_completion_t *comp,
+                int timeout);
+
+int sdp_submit_get_dev_addr(sdp_async_t *async, sdp_t *sdp, int *addr);
+int sdp_submit_get_va_maximums(sdp_async_t *async, sdp_t *sdp,
+                sdp_va_t *va_maximums);
+int sdp_submit_get_volt_limit(sdp_async_t *async, sdp_t *sdp, double *volt);
+int sdp_submit_get_va_data(sdp_async_t *async, sdp_t *sdp,
+                sdp_va_data_t *va_data);
+int sdp_submit_get_va_setpoint(sdp_async_t *async, sdp_t *sdp,
+                sdp_va_t *va_setpoints);
+int sdp_submit_get_preset(sdp_async_t *async, sdp_t *sdp, int presn,
+                sdp_va_t *va_preset);
+int sdp_submit_get_program(sdp_async_t *async, sdp_t *sdp, int progn,
+                sdp_program_t *program);
+int sdp_submit_get_lcd_info(sdp_async_t *async, sdp_t *sdp,
+                sdp_lcd_info_t *lcd_info);
+int sdp_submit_remote(sdp_async_t *async, sdp_t *sdp, int enable);
+int sdp_submit_run_preset(sdp_async_t *async, sdp_t *sdp, int preset);
+int sdp_submit_run_program(sdp_async_t *async, sdp_t *sdp, int count);
+int sdp_submit_select_ifce(sdp_async_t *async, sdp_t *sdp, sdp_ifce_t ifce);
+int sdp_submit_set_curr(sdp_async_t *async, sdp_t *sdp, double curr);
+int sdp_submit_set_volt(sdp_async_t *async, sdp_t *sdp, double volt);
+int sdp_submit_set_volt_limit(sdp_async_t *async, sdp_t *sdp, double volt);
+int sdp_submit_set_output(sdp_async_t *async, sdp_t *sdp, int enable);
+int sdp_submit_set_poweron_output(sdp_async_t *async, sdp_t *sdp, int presn,
+                int enable);
+int sdp_submit_set_preset(sdp_async_t *async, sdp_t *sdp, int presn,
+                const sdp_va_t *va_preset);
+int sdp_submit_set_program(sdp_async_t *async, sdp_t *sdp, int progn,
+                const sdp_program_t *program);
+int sdp_submit_stop(sdp_async_t *async, sdp_t *sdp);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -70,6 +70,8 @@ extern "C" {
 #define SDP_ETOLARGE    (-6)
 /** Write operation returned with data partialy writen. */
 #define SDP_EWINCOMPL   (-8)
+/** Device does not respond, request rejected by circuit breaker. */
+#define SDP_EDEVDOWN    (-9)
 
 #ifdef __linux__
 #define SDP_F int
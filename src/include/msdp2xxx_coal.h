@@ -0,0 +1,70 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_COAL_H___
+#define __MSDP2XXX_COAL_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+/**
+ * Statistics of read coalescer.
+ */
+typedef struct {
+        /** number of read exchanges with device */
+        unsigned long exchanges;
+        /** number of reads attached to exchange in progress */
+        unsigned long attached;
+        /** number of reads served from result within freshness window */
+        unsigned long fresh;
+} sdp_coal_stats_t;
+
+/**
+ * Function exchanging command with device, used by coalescer.
+ */
+typedef int (*sdp_xfer_fn_t)(sdp_t *sdp, char *buf, int len, int size);
+
+int sdp_coal_start(sdp_t *sdp, int fresh_ms);
+void sdp_coal_stop(sdp_t *sdp);
+int sdp_coal_op(sdp_op_t op);
+int sdp_coal_xfer(sdp_t *sdp, char *buf, int len, int size,
+                sdp_xfer_fn_t xfer);
+void sdp_coal_invalidate(sdp_t *sdp);
+int sdp_coal_get_stats(sdp_t *sdp, sdp_coal_stats_t *stats);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_DISC_H___
+#define __MSDP2XXX_DISC_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+#include <time.h>
+
+/** Maximal lenght of port name in registry, including '\0'. */
+#define SDP_DISC_PORT_MAX (64)
+
+/**
+ * Device found on bus, one record of registry.
+ */
+typedef struct {
+        /** serial port device is connected to */
+        char port[SDP_DISC_PORT_MAX];
+        /** device address */
+        int addr;
+        /** maximal voltage and current reported by GMAX */
+        sdp_va_t va_maximums;
+        /** time device responded last time */
+        time_t seen;
+} sdp_disc_dev_t;
+
+int sdp_discover(const char * const *ports, int count, sdp_disc_dev_t *devs,
+                int size);
+int sdp_disc_validate(sdp_disc_dev_t *devs, int count);
+int sdp_disc_load(const char *fname, sdp_disc_dev_t *devs, int size);
+int sdp_disc_save(const char *fname, const sdp_disc_dev_t *devs, int count);
+int sdp_disc_registry(const char *fname, const char * const *ports,
+                int count, sdp_disc_dev_t *devs, int size);
+int sdp_disc_attach(sdp_t *sdp, const char *port, const sdp_disc_dev_t *devs,
+                int count);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
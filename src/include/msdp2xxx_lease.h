@@ -0,0 +1,74 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_LEASE_H___
+#define __MSDP2XXX_LEASE_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+#include <sys/types.h>
+
+/** Directory of lease files used when XDG_RUNTIME_DIR is not set, might be
+ * overriden by environment variable MSDP_LEASE_DIR. */
+#define SDP_LEASE_DIR "/run/lock"
+
+/**
+ * Lease of remote sessions on one port. State file records expiry of
+ *      session of each device address and pid of process which ends
+ *      lapsed sessions (see sdp_lease_reap). The file is locked for whole
+ *      time between sdp_lease_lock and sdp_lease_unlock, so it also
+ *      serializes processes using the port.
+ */
+typedef struct {
+        /** locked state file */
+        int fd;
+        /** device address of session */
+        int addr;
+        /** expiry of session of each address, 0 when there is no session,
+         * wall clock time [us] */
+        long long expiry[SDP_DEV_ADDR_MAX + 1];
+        /** process ending lapsed sessions, 0 when not running */
+        pid_t reaper;
+} sdp_lease_t;
+
+int sdp_lease_lock(sdp_lease_t *lease, const char *port, int addr);
+int sdp_lease_unlock(sdp_lease_t *lease, long ttl);
+int sdp_lease_reap(const char *port);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_LOOP_H___
+#define __MSDP2XXX_LOOP_H___
+
+#include "msdp2xxx.h"
+#include "msdp2xxx_sched.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+typedef struct sdp_loop_port sdp_loop_port_t;
+
+/**
+ * Event loop driving many SDP devices at once. Each registered device has
+ *      priority queue of requests (see sdp_sched_t), requests are written
+ *      and responses are recieved without blocking, all devices share one
+ *      epoll instance.
+ */
+typedef struct {
+        /** epoll file descriptor */
+        int epfd;
+        /** registered devices */
+        sdp_loop_port_t **ports;
+        /** number of registered devices */
+        int count;
+        /** allocated size of ports */
+        int alloc;
+        /** number of submitted and not yet completed requests */
+        int pending;
+        /** number of completed requests */
+        unsigned long completed;
+        /** removed devices which might be still referenced, freed when
+         * loop is not running */
+        sdp_loop_port_t *dead;
+        /** non zero while sdp_loop_run processes events */
+        int running;
+} sdp_loop_t;
+
+int sdp_loop_init(sdp_loop_t *loop);
+void sdp_loop_close(sdp_loop_t *loop);
+int sdp_loop_add(sdp_loop_t *loop, sdp_t *sdp);
+int sdp_loop_del(sdp_loop_t *loop, sdp_t *sdp);
+int sdp_loop_submit(sdp_loop_t *loop, sdp_t *sdp, sdp_req_t *req);
+int sdp_loop_run(sdp_loop_t *loop, int timeout);
+int sdp_loop_timeout(sdp_loop_t *loop);
+int sdp_loop_get_sched_stats(sdp_loop_t *loop, sdp_t *sdp,
+                sdp_sched_stats_t *stats);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -37,6 +37,18 @@ extern "C" {
 /** lenght of shortest valid response ("OK\r") */
 #define SDP_RESP_LEN_OK 3
 
+/* Conversion of integers send to device to values [V], [A], see
+ * sdp_volt2int and sdp_curr2int. */
+#define SDP_INT2VOLT(u) (((double)(u)) / 10)
+#define SDP_INT2CURR(i) (((double)(i)) / 100)
+
+/** Maximal number of late responses expected by sdp_rx_t. */
+#define SDP_RX_STALE_MAX (4)
+
+/** Size of receive ring buffer, must be power of 2 and large enough to hold
+ * longest response (GETP with all program items, 223 bytes). */
+#define SDP_RX_BUF_SIZE (256)
+
 typedef enum {
         /** response is not complete */
         sdp_resp_incomplete = 0,
@@ -84,9 +96,185 @@ typedef struct {
         unsigned char remote_ind;
 } sdp_lcd_info_raw_t;
 
+/**
+ * Identification of SDP command, see SDP power supply manual.
+ */
+typedef enum {
+        /** unknown command */
+        sdp_op_unknown = 0,
+        sdp_op_sess,
+        sdp_op_ends,
+        sdp_op_ccom,
+        sdp_op_gcom,
+        sdp_op_gmax,
+        sdp_op_govp,
+        sdp_op_getd,
+        sdp_op_gets,
+        /** GETM for one preset */
+        sdp_op_getm,
+        /** GETM for all presets */
+        sdp_op_getm_all,
+        /** GETP for one program item */
+        sdp_op_getp,
+        /** GETP for all program items */
+        sdp_op_getp_all,
+        sdp_op_gpal,
+        sdp_op_volt,
+        sdp_op_curr,
+        sdp_op_sovp,
+        sdp_op_sout,
+        sdp_op_poww,
+        sdp_op_prom,
+        sdp_op_prop,
+        sdp_op_runm,
+        sdp_op_runp,
+        sdp_op_stop,
+        /** number of commands, not a command */
+        sdp_op_count,
+} sdp_op_t;
+
+/** Measured voltage, sdp_va_data_t volt. */
+#define SDP_FIELD_VOLT          (1 << 0)
+/** Measured current, sdp_va_data_t curr. */
+#define SDP_FIELD_CURR          (1 << 1)
+/** CV/CC mode, sdp_va_data_t mode. */
+#define SDP_FIELD_MODE          (1 << 2)
+/** Voltage setpoint, sdp_va_t volt. */
+#define SDP_FIELD_SET_VOLT      (1 << 3)
+/** Current setpoint, sdp_va_t curr. */
+#define SDP_FIELD_SET_CURR      (1 << 4)
+/** Power, sdp_lcd_info_t read_W. */
+#define SDP_FIELD_POWER         (1 << 5)
+/** Remaining time of program item, sdp_lcd_info_t time. */
+#define SDP_FIELD_TIME          (1 << 6)
+/** Program state, sdp_lcd_info_t prog, prog_on and prog_bar. */
+#define SDP_FIELD_PROG          (1 << 7)
+/** Output state, sdp_lcd_info_t output. */
+#define SDP_FIELD_OUTPUT        (1 << 8)
+/** Fault indicator, sdp_lcd_info_t fault_ind. */
+#define SDP_FIELD_FAULT         (1 << 9)
+/** Keypad lock, sdp_lcd_info_t key. */
+#define SDP_FIELD_KEY           (1 << 10)
+/** Remote control indicator, sdp_lcd_info_t remote_ind. */
+#define SDP_FIELD_REMOTE        (1 << 11)
+
+/** Fields stored in sdp_va_data_t. */
+#define SDP_FIELD_VA_DATA \
+        (SDP_FIELD_VOLT | SDP_FIELD_CURR | SDP_FIELD_MODE)
+/** Fields stored in sdp_va_t setpoint. */
+#define SDP_FIELD_SETPOINT (SDP_FIELD_SET_VOLT | SDP_FIELD_SET_CURR)
+/** Fields stored only in sdp_lcd_info_t. */
+#define SDP_FIELD_LCD_INFO \
+        (SDP_FIELD_POWER | SDP_FIELD_TIME | SDP_FIELD_PROG | \
+         SDP_FIELD_OUTPUT | SDP_FIELD_FAULT | SDP_FIELD_KEY | \
+         SDP_FIELD_REMOTE)
+/** All fields. */
+#define SDP_FIELD_ALL \
+        (SDP_FIELD_VA_DATA | SDP_FIELD_SETPOINT | SDP_FIELD_LCD_INFO)
+
+/** Maximal number of reads query is served by, see sdp_query_plan. */
+#define SDP_QUERY_OPS_MAX 3
+/** Delay of device to reaction on command, added to every exchange [us]. */
+#define SDP_REACT_TIME (70000l)
+
+/**
+ * Priority class of command, schedulers send commands of lower class first.
+ */
+typedef enum {
+        /** commands switching output off, SOUT off and STOP */
+        sdp_class_safety = 0,
+        /** commands changing state of device */
+        sdp_class_control,
+        /** reading of measured values and settings */
+        sdp_class_telemetry,
+        /** reading and writing of presets and programs */
+        sdp_class_bulk,
+        /** number of classes, not a class */
+        sdp_class_count,
+} sdp_class_t;
+
+/**
+ * Models of power supply, see sdp_caps_t.
+ */
+typedef enum {
+        /** model was not identified, only generic ranges are checked */
+        sdp_model_unknown = 0,
+        sdp_model_2210,
+        sdp_model_2405,
+        sdp_model_2603,
+        /** number of models, not a model */
+        sdp_model_count,
+} sdp_model_t;
+
+/**
+ * Capabilities of one model of power supply.
+ */
+typedef struct {
+        sdp_model_t model;
+        /** model name */
+        const char *name;
+        /** highest voltage [V] and current [A] which might be set, current
+         * of 10 A model is limited to 9.99 A by three digit encoding,
+         * same values are reported by GMAX */
+        sdp_va_t va_maximums;
+} sdp_caps_t;
+
+/**
+ * Incremental response framer. Stores bytes received from device in ring
+ * buffer and tracks state of "\rOK\r" terminator across reads, so every
+ * byte is scanned only once and bytes following complete response are kept
+ * for next call.
+ */
+typedef struct {
+        /** ring buffer with recieved data */
+        char buf[SDP_RX_BUF_SIZE];
+        /** index of first byte of current response in buf */
+        unsigned int head;
+        /** number of bytes stored in buf */
+        unsigned int len;
+        /** number of bytes already scanned for terminator */
+        unsigned int scan;
+        /** lenght of complete response at head, 0 when not complete yet */
+        unsigned int frame;
+        /** terminator match state */
+        int term;
+        /** 1 when rest of response rejected as too long is dropped */
+        int skip;
+        /** number of responses which might still arrive after their
+         * request timed out */
+        unsigned int stale;
+} sdp_rx_t;
+
 /* Low level operation functions */
 sdp_resp_t sdp_resp(const char *buf, int len);
 
+sdp_op_t sdp_op_id(const char *buf, int len);
+int sdp_op_resp_len(sdp_op_t op);
+int sdp_resp_len(const char *buf, int len);
+sdp_class_t sdp_cmd_class(const char *buf, int len);
+int sdp_cmd_addr(const char *buf, int len);
+int sdp_cmd_setpoint(const char *buf, int len);
+unsigned int sdp_op_fields(sdp_op_t op);
+long sdp_op_wire_time(sdp_op_t op);
+long sdp_op_cost(sdp_op_t op);
+int sdp_query_plan(unsigned int fields, const long *cost,
+                sdp_op_t ops[SDP_QUERY_OPS_MAX]);
+
+const sdp_caps_t *sdp_model_caps(sdp_model_t model);
+sdp_model_t sdp_model_identify(const sdp_va_t *va_maximums);
+int sdp_volt2int(double volt);
+int sdp_curr2int(double curr);
+int sdp_caps_check_volt(const sdp_caps_t *caps, double volt);
+int sdp_caps_check_curr(const sdp_caps_t *caps, double curr);
+int sdp_caps_check_cmd(const sdp_caps_t *caps, const char *buf, int len);
+
+void sdp_rx_init(sdp_rx_t *rx);
+int sdp_rx_space(sdp_rx_t *rx, char **buf);
+int sdp_rx_commit(sdp_rx_t *rx, int count);
+int sdp_rx_frame(sdp_rx_t *rx, char *buf, int size);
+int sdp_rx_resp(sdp_rx_t *rx, char *buf, int size, int exact);
+void sdp_rx_expire(sdp_rx_t *rx);
+
 /* This functions return some data (sdp_resp_data), use corecponding
  * sdp_resp_* function to get this data from response message */
 int sdp_sget_dev_addr(char *buf, int addr);
@@ -0,0 +1,77 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_MIRROR_H___
+#define __MSDP2XXX_MIRROR_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of presets stored in device. */
+#define SDP_PRESET_COUNT (SDP_PRESET_MAX - SDP_PRESET_MIN + 1)
+/** Number of program items stored in device. */
+#define SDP_PROGRAM_COUNT (SDP_PROGRAM_MAX - SDP_PROGRAM_MIN + 1)
+
+/**
+ * Mirror of presets and program stored in device memory. Image is loaded
+ *      by two bulk reads and then kept equal to device by writing only
+ *      slots whose values differ after conversion to values send on wire,
+ *      every skipped write saves one EEPROM write.
+ */
+typedef struct {
+        /** device */
+        sdp_t *sdp;
+        /** presets, index 0 is preset SDP_PRESET_MIN */
+        sdp_va_t preset[SDP_PRESET_COUNT];
+        /** program items, index 0 is item SDP_PROGRAM_MIN */
+        sdp_program_t program[SDP_PROGRAM_COUNT];
+        /** 1 when slot is known to be equal to device */
+        char preset_valid[SDP_PRESET_COUNT];
+        char program_valid[SDP_PROGRAM_COUNT];
+        /** number of slots writen to device */
+        unsigned long writes;
+        /** number of writes skipped as slot was already equal */
+        unsigned long skipped;
+} sdp_mirror_t;
+
+void sdp_mirror_init(sdp_mirror_t *mirror, sdp_t *sdp);
+int sdp_mirror_load(sdp_mirror_t *mirror);
+int sdp_mirror_set_preset(sdp_mirror_t *mirror, int presn,
+                const sdp_va_t *va_preset);
+int sdp_mirror_set_program(sdp_mirror_t *mirror, int progn,
+                const sdp_program_t *program);
+int sdp_mirror_sync(sdp_mirror_t *mirror, const sdp_va_t *presets,
+                const sdp_program_t *programs);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_MSDPD_H___
+#define __MSDP2XXX_MSDPD_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+#include <stdint.h>
+
+/** Default path of msdpd socket, used when XDG_RUNTIME_DIR is not set. */
+#define SDP_MSDPD_SOCKET "/run/msdpd.sock"
+/** Name of msdpd socket in XDG_RUNTIME_DIR. */
+#define SDP_MSDPD_SOCKET_NAME "msdpd.sock"
+/** Environment variable overriding default path of socket. */
+#define SDP_MSDPD_SOCKET_ENV "MSDPD_SOCKET"
+/** First bytes of hello message, "MSD" and protocol version. */
+#define SDP_MSDPD_MAGIC (0x4d534402u)
+/** Maximal lenght of port name in hello message, including '\0'. */
+#define SDP_MSDPD_PORT_MAX (108)
+
+/*
+ * msdpd protocol. Client connects to SOCK_SEQPACKET Unix socket and sends
+ * sdp_msdpd_hello_t, daemon answers by sdp_msdpd_hdr_t with ret 0 when it
+ * serves the port. Then each message from client is sdp_msdpd_req_t
+ * followed by one command prepared by sdp_s* function and daemon answers
+ * by sdp_msdpd_hdr_t with the same sequence number followed by response of
+ * device. Client drops answers with other sequence number, these are late
+ * answers on requests it stopped waiting for. Remote session is kept open
+ * by daemon, SESS and ENDS are answered by daemon.
+ */
+
+/**
+ * First message of client.
+ */
+typedef struct {
+        /** SDP_MSDPD_MAGIC */
+        uint32_t magic;
+        /** serial port device is connected to */
+        char port[SDP_MSDPD_PORT_MAX];
+} sdp_msdpd_hello_t;
+
+/**
+ * Header of client request.
+ */
+typedef struct {
+        /** sequence number of request, 0 is used by hello message */
+        uint32_t seq;
+} sdp_msdpd_req_t;
+
+/**
+ * Header of daemon answer.
+ */
+typedef struct {
+        /** sequence number of answered request */
+        uint32_t seq;
+        /** lenght of response, or negative number (error no.) on error */
+        int16_t ret;
+        /** value of errno when ret is SDP_EERRNO */
+        uint16_t err;
+} sdp_msdpd_hdr_t;
+
+int sdp_msdpd_socket(char *buf, int size);
+int sdp_msdpd_open(sdp_t *sdp, const char *sock, const char *fname, int addr);
+int sdp_msdpd_xfer(sdp_t *sdp, char *buf, int len, int size);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,120 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_POLL_H___
+#define __MSDP2XXX_POLL_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Statistics of polling of one device.
+ */
+typedef struct {
+        /** number of exchanges */
+        unsigned long polls;
+        /** number of failed exchanges */
+        unsigned long errors;
+        /** number of periods dropped because device was not polled
+         * in time */
+        unsigned long missed;
+        /** bus time spent on exchanges with device [us] */
+        long long wire;
+        /** estimated bus time of one exchange [us] */
+        long est;
+} sdp_poll_dev_stats_t;
+
+/**
+ * Statistics of polling of whole bus.
+ */
+typedef struct {
+        /** fraction of bus time demanded by all polling targets, bus is
+         * oversubscribed when greater than 1 */
+        double demand;
+        /** bus time spent on exchanges [us] */
+        long long busy;
+        /** number of periods dropped on all devices */
+        unsigned long missed;
+} sdp_poll_stats_t;
+
+/**
+ * Polling target of one device, used internaly.
+ */
+typedef struct {
+        /** polling period [us], 0 when device is not polled */
+        long period;
+        /** time next poll is due [us] */
+        long long due;
+        /** 1 when poll is due and start tag is assigned */
+        int ready;
+        /** virtual start and finish time of last poll */
+        long long start;
+        long long finish;
+        /** request send to device */
+        sdp_req_t req;
+        sdp_poll_dev_stats_t stats;
+} sdp_poll_dev_t;
+
+/**
+ * Poller of devices sharing one RS485 line. Each device is polled by one
+ *      command at requested period. When more devices are due at once,
+ *      they are served in order of weighted fair queuing (start-time fair
+ *      queuing): actual bus time of each exchange is charged against
+ *      budget of device, which is estimated exchange time times polling
+ *      rate. When bus is oversubscribed each device gets the same fraction
+ *      of its polling rate. Devices with open circuit breaker (see
+ *      sdp_set_breaker) are not polled until backoff expires.
+ */
+typedef struct {
+        /** port all devices are connected to */
+        sdp_t *sdp;
+        /** virtual time, start tag of last served device */
+        long long vtime;
+        /** targets indexed by device address */
+        sdp_poll_dev_t dev[SDP_DEV_ADDR_MAX + 1];
+        /** bus time spent on exchanges [us] */
+        long long busy;
+        /** number of periods dropped on all devices */
+        unsigned long missed;
+} sdp_poll_t;
+
+void sdp_poll_init(sdp_poll_t *poll, sdp_t *sdp);
+int sdp_poll_set(sdp_poll_t *poll, int addr, sdp_op_t op, long period,
+                sdp_req_cb_t cb, void *priv);
+int sdp_poll_step(sdp_poll_t *poll, long *wait);
+void sdp_poll_get_stats(sdp_poll_t *poll, sdp_poll_stats_t *stats);
+int sdp_poll_get_dev_stats(sdp_poll_t *poll, int addr,
+                sdp_poll_dev_stats_t *stats);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
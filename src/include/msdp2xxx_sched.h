@@ -0,0 +1,79 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_SCHED_H___
+#define __MSDP2XXX_SCHED_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+/**
+ * Queueing statistics of one priority class.
+ */
+typedef struct {
+        /** number of requests taken from queue */
+        unsigned long count;
+        /** sum of time requests spent in queue [us] */
+        long long delay_sum;
+        /** longest time request spent in queue [us] */
+        long long delay_max;
+} sdp_sched_stats_t;
+
+/**
+ * Priority queue of requests of one port. Request of the highest
+ *      priority class is taken first, requests of the same class are taken
+ *      in order of submission, control request does not pass earlier bulk
+ *      write to the same device. Request in progress is never interrupted,
+ *      so safety command waits at most for one exchange.
+ */
+typedef struct {
+        /** first and last request of each class */
+        sdp_req_t *head[sdp_class_count];
+        sdp_req_t *tail[sdp_class_count];
+        /** statistics of each class */
+        sdp_sched_stats_t stats[sdp_class_count];
+} sdp_sched_t;
+
+void sdp_sched_init(sdp_sched_t *sched);
+sdp_req_t *sdp_sched_push(sdp_sched_t *sched, sdp_req_t *req,
+                sdp_shadow_t *shadow);
+sdp_req_t *sdp_sched_pop(sdp_sched_t *sched);
+void sdp_sched_get_stats(sdp_sched_t *sched,
+                sdp_sched_stats_t stats[sdp_class_count]);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,134 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_SHM_H___
+#define __MSDP2XXX_SHM_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Default name of shared memory segment. */
+#define SDP_SHM_NAME "/msdp2xxx"
+/** Maximal lenght of port name stored in slot, including '\0'. */
+#define SDP_SHM_PORT_MAX (64)
+/** Number of attempts of reader to get consistent copy of slot and of
+ * writer to lock slot. */
+#define SDP_SHM_RETRY (64)
+
+/** Parts of published device state. */
+#define SDP_SHM_VA_DATA         (1 << 0)
+#define SDP_SHM_SETPOINT        (1 << 1)
+#define SDP_SHM_LCD_INFO        (1 << 2)
+
+/**
+ * Latest published state of device.
+ */
+typedef struct {
+        /** bitmask of SDP_SHM_* parts which were published */
+        unsigned int valid;
+        /** time of publication of each part, see sdp_time_us [us] */
+        long long va_data_time;
+        long long setpoint_time;
+        long long lcd_info_time;
+        /** result of sdp_get_va_data */
+        sdp_va_data_t va_data;
+        /** result of sdp_get_va_setpoint */
+        sdp_va_t setpoint;
+        /** result of sdp_get_lcd_info */
+        sdp_lcd_info_t lcd_info;
+} sdp_shm_data_t;
+
+/**
+ * Slot of one device in shared memory, protected by seqlock.
+ */
+typedef struct {
+        /** sequence number, odd while slot is being writen */
+        uint32_t seq;
+        /** process which locked slot last time, lock of process which died
+         * while writing is taken over */
+        int32_t writer;
+        /** RS485 address of device, 0 when slot is free */
+        int addr;
+        /** serial port device is connected to */
+        char port[SDP_SHM_PORT_MAX];
+        /** published state */
+        sdp_shm_data_t data;
+} sdp_shm_slot_t;
+
+/**
+ * Header of shared memory segment.
+ */
+typedef struct {
+        /** SDP_SHM_MAGIC */
+        uint32_t magic;
+        /** sizeof(sdp_shm_slot_t) */
+        uint32_t slot_size;
+        /** number of slots */
+        uint32_t slots;
+} sdp_shm_hdr_t;
+
+/** Identification of shared memory segment, "SDPS" and version. */
+#define SDP_SHM_MAGIC (0x53445002u)
+
+/**
+ * Mapped shared memory segment.
+ */
+typedef struct sdp_shm {
+        /** mapped segment */
+        sdp_shm_hdr_t *hdr;
+        /** slots following header */
+        sdp_shm_slot_t *slot;
+        /** size of mapping */
+        size_t size;
+} sdp_shm_t;
+
+int sdp_shm_create(sdp_shm_t *shm, const char *name, int slots, int mode);
+int sdp_shm_open(sdp_shm_t *shm, const char *name);
+void sdp_shm_close(sdp_shm_t *shm);
+int sdp_shm_slot(sdp_shm_t *shm, const char *port, int addr);
+int sdp_shm_find(sdp_shm_t *shm, const char *port, int addr);
+int sdp_shm_publish(sdp_shm_t *shm, int slot, const sdp_shm_data_t *data,
+                unsigned int parts);
+int sdp_shm_read(sdp_shm_t *shm, int slot, sdp_shm_data_t *data);
+int sdp_shm_attach(sdp_t *sdp, sdp_shm_t *shm, const char *port);
+void sdp_shm_put(sdp_t *sdp, unsigned int part, const void *value);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+/*##############################################################################
+* Copyright (c) 2009-2010, Jiří Pinkava                                        #
+# All rights reserved.                                                         #
+#                                                                              #
+# Redistribution and use in source and binary forms, with or without           #
+# modification, are permitted provided that the following conditions are met:  #
+#     * Redistributions of source code must retain the above copyright         #
+#       notice, this list of conditions and the following disclaimer.          #
+#     * Redistributions in binary form must reproduce the above copyright      #
+#       notice, this list of conditions and the following disclaimer in the    #
+#       documentation and/or other materials provided with the distribution.   #
+#     * Neither the name of the Jiří Pinkava nor the                           #
+#       names of its contributors may be used to endorse or promote products   #
+#       derived from this software without specific prior written permission.  #
+#                                                                              #
+# THIS SOFTWARE IS PROVIDED BY Jiří Pinkava ''AS IS'' AND ANY                  #
+# EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED    #
+# WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE       #
+# DISCLAIMED. IN NO EVENT SHALL Jiří Pinkava BE LIABLE FOR ANY                 #
+# DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES   #
+# (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; #
+# LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND  #
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT   #
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS#
+# SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.                 *
+##############################################################################*/
+
+#ifndef __MSDP2XXX_URING_H___
+#define __MSDP2XXX_URING_H___
+
+#include "msdp2xxx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef __linux__
+
+/** Size of registered command buffer of one port, large enough for batch. */
+#define SDP_URING_TX_SIZE ((SDP_BATCH_MAX + 1) * SDP_BUF_SIZE_MIN)
+
+typedef struct sdp_uring_slot sdp_uring_slot_t;
+
+/**
+ * io_uring instance shared by several ports. Every attached port has
+ *      registered buffer for command and for response, commands and reads
+ *      of all ports are submitted and completed by single io_uring_enter.
+ */
+typedef struct sdp_uring {
+        /** io_uring file descriptor */
+        int fd;
+        /** mapped submission ring, completion ring and submission entries */
+        void *sq_ring;
+        void *cq_ring;
+        void *sqes;
+        unsigned int sq_ring_size;
+        unsigned int cq_ring_size;
+        unsigned int sqes_size;
+        /** pointers into submission ring */
+        unsigned int *sq_head;
+        unsigned int *sq_tail;
+        unsigned int *sq_mask;
+        unsigned int *sq_array;
+        /** pointers into completion ring */
+        unsigned int *cq_head;
+        unsigned int *cq_tail;
+        unsigned int *cq_mask;
+        void *cqes;
+        /** number of prepared entries not submitted yet */
+        unsigned int to_submit;
+        /** registered buffers, command and response buffer of every slot */
+        char *bufs;
+        /** attached ports, indexed by slot */
+        sdp_uring_slot_t *slot;
+        /** number of slots */
+        int slots;
+        /** number of slots with exchange in progress */
+        int busy;
+        /** number of io_uring_enter calls */
+        unsigned long enters;
+} sdp_uring_t;
+
+int sdp_uring_init(sdp_uring_t *ur, int ports);
+void sdp_uring_close(sdp_uring_t *ur);
+int sdp_uring_add(sdp_uring_t *ur, sdp_t *sdp);
+int sdp_uring_del(sdp_uring_t *ur, sdp_t *sdp);
+int sdp_uring_xfer(sdp_uring_t *ur, sdp_req_t **reqs, int count);
+
+int sdp_uring_write(sdp_t *sdp, const char *buf, int count);
+int sdp_uring_read_resp(sdp_t *sdp, char *buf, int count, int exact,
+                long timeout_us);
+
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
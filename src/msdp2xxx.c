@@ -18,32 +18,78 @@
 
 #include "msdp2xxx.h"
 #include "msdp2xxx_low.h"
+#include "msdp2xxx_coal.h"
+#include "msdp2xxx_msdpd.h"
+#include "msdp2xxx_mt.h"
+#include "msdp2xxx_shm.h"
+#include "msdp2xxx_uring.h"
 #include <ctype.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 #ifdef __linux__
 
+#include <linux/serial.h>
+#include <poll.h>
 #include <termios.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/select.h>
 #include <unistd.h>
 
+/**
+ * Switch serial port driver to low latency mode.
+ * @param fd    File descriptor of serial port.
+ * @return      0 on success, negative number (err no.) when driver does not
+ *      support low latency mode.
+ */
+static int serial_low_latency(int fd)
+{
+        struct serial_struct ss;
+
+        if (ioctl(fd, TIOCGSERIAL, &ss) < 0)
+                return SDP_EERRNO;
+        ss.flags |= ASYNC_LOW_LATENCY;
+        if (ioctl(fd, TIOCSSERIAL, &ss) < 0)
+                return SDP_EERRNO;
+
+        /* some drivers silently ignore the flag */
+        if (ioctl(fd, TIOCGSERIAL, &ss) < 0)
+                return SDP_EERRNO;
+        if (!(ss.flags & ASYNC_LOW_LATENCY)) {
+                errno = ENOTSUP;
+                return SDP_EERRNO;
+        }
+
+        return 0;
+}
+
 /**
  * Open serial port and set parameters as defined for SDP power source.
+ *      Optional settings which system refuses are not treated as error,
+ *      only not reported in opts->accepted.
  * @param fname File name of serial port.
+ * @param opts  Options, see sdp_open_ex.
  * @return      File descriptor on success, negative number (err no.) on error.
  */
-static int open_serial(const char* fname)
+static int open_serial(const char* fname, sdp_open_opts_t *opts)
 {
         int fd;
         struct termios tio;
 
+        opts->accepted = 0;
+
         fd = open(fname, O_RDWR | O_NONBLOCK);
         if (fd < 0)
                 return SDP_EERRNO;
 
+        if ((opts->flags & SDP_OPEN_EXCL) && ioctl(fd, TIOCEXCL) >= 0)
+                opts->accepted |= SDP_OPEN_EXCL;
+
         memset(&tio, 0, sizeof(tio));
         tio.c_cflag = CS8 | CREAD | CLOCAL;
         tio.c_cc[VMIN] = 1;
@@ -59,9 +105,107 @@ static int open_serial(const char* fname)
                 return SDP_EERRNO;
         }
 
+        if ((opts->flags & SDP_OPEN_LOW_LATENCY) &&
+                        serial_low_latency(fd) >= 0)
+                opts->accepted |= SDP_OPEN_LOW_LATENCY;
+
+        if ((opts->flags & SDP_OPEN_FLUSH) && tcflush(fd, TCIFLUSH) >= 0)
+                opts->accepted |= SDP_OPEN_FLUSH;
+
         return fd;
 }
 
+/**
+ * Set VMIN and VTIME of serial port, skip call when values did not change.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param vmin  Value of VMIN.
+ * @param vtime Value of VTIME [ds].
+ * @return      0 on success, negative number (err no.) on error.
+ */
+static int sdp_set_vtime(sdp_t *sdp, int vmin, int vtime)
+{
+        struct termios tio;
+        int tio_ = (vmin << 8) | vtime;
+
+        if (sdp->wait_tio == tio_)
+                return 0;
+
+        sdp->io.syscalls += 2;
+        if (tcgetattr(sdp->f_in, &tio) < 0)
+                return SDP_EERRNO;
+        tio.c_cc[VMIN] = vmin;
+        tio.c_cc[VTIME] = vtime;
+        if (tcsetattr(sdp->f_in, TCSANOW, &tio) < 0)
+                return SDP_EERRNO;
+        sdp->wait_tio = tio_;
+
+        return 0;
+}
+
+/**
+ * Wait until data are available on f_in.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param deadline      Time when wait expire, see sdp_time_us [us].
+ * @param want  Number of bytes missing to complete response.
+ * @return      Positive number when data are available, 0 on timeout,
+ *      negative number on error.
+ */
+static int sdp_wait_in(sdp_t *sdp, long long deadline, int want)
+{
+        long long timeout;
+        int ret;
+
+        timeout = deadline - sdp_time_us();
+        if (timeout < 0)
+                timeout = 0;
+
+        switch (sdp->wait) {
+        case sdp_wait_poll:
+        case sdp_wait_vmin: {
+                struct pollfd pfd;
+
+                pfd.fd = sdp->f_in;
+                pfd.events = POLLIN;
+                ret = poll(&pfd, 1, (timeout + 999) / 1000);
+                if (ret <= 0 || sdp->wait != sdp_wait_vmin)
+                        break;
+                /* response is flowing, let read() return it whole */
+                if (want > 255)
+                        want = 255;
+                if (sdp_set_vtime(sdp, want, 1) < 0)
+                        ret = -1;
+                break;
+        }
+        case sdp_wait_epoll: {
+                struct epoll_event ev;
+
+                /* edge triggered, wait only when all data were readed */
+                if (sdp->wait_ready)
+                        return 1;
+                ret = epoll_wait(sdp->wait_fd, &ev, 1, (timeout + 999) / 1000);
+                if (ret > 0)
+                        sdp->wait_ready = 1;
+                break;
+        }
+        default: {
+                struct timeval tv;
+                fd_set readfds;
+
+                FD_ZERO(&readfds);
+                FD_SET(sdp->f_in, &readfds);
+                tv.tv_sec = timeout / 1000000l;
+                tv.tv_usec = timeout % 1000000l;
+                ret = select(sdp->f_in + 1, &readfds, NULL, NULL, &tv);
+                break;
+        }
+        }
+
+        sdp->io.syscalls++;
+        sdp->io.wakeups++;
+
+        return ret;
+}
+
 /**
  * Close opened serial port, if f == -1 do nothigh.
  * @param f     File descriptor.
@@ -73,70 +217,238 @@ static void close_serial(int f)
 }
 
 /**
- * Reads data from serial port.
- * @param fd    File descriptor.
- * @param buf   Buffer to store readed data.
- * @param count Maximal amount of bytes to read.
+ * Reads response from serial port. Data are recieved into framer of sdp,
+ *      bytes recieved after end of response are kept there for next call.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer to store readed response.
+ * @param count Lenght of expected response, longer response is rejected
+ *      as soon as it is recognized.
+ * @param exact 1 when count is exact lenght of response.
+ * @param timeout_us    Time to wait for response [us].
  * @return      Number of bytes succesfully readed, or gefative number
  *      (error no.) on error.
  */
-static ssize_t sdp_read_resp(int fd, char *buf, ssize_t count)
+static ssize_t sdp_read_resp(sdp_t *sdp, char *buf, ssize_t count,
+                int exact, long timeout_us)
 {
-        const char *buf_ = buf;
-        fd_set readfds;
+        long long deadline;
         int ret;
-        ssize_t size = 0;
-        struct timeval timeout;
 
-        FD_ZERO(&readfds);
-        FD_SET(fd, &readfds);
+        if (sdp->uring)
+                return sdp_uring_read_resp(sdp, buf, count, exact,
+                                timeout_us);
 
-        // TODO: check this value
-        timeout.tv_sec = 0;
-        // (bytes * 10 * usec) / bitrate + delay_to_reaction;
-        timeout.tv_usec = (count * 10l * 1000000l) / 9600l + 70000l;
-        do {
+        deadline = sdp_time_us() + timeout_us;
+        while (!(ret = sdp_rx_resp(&sdp->rx, buf, count, exact))) {
                 ssize_t size_;
+                char *rx_buf;
+                int space;
+
+                space = sdp_rx_space(&sdp->rx, &rx_buf);
+                if (!space) {
+                        sdp_rx_init(&sdp->rx);
+                        errno = ERANGE;
+                        return SDP_ETOLARGE;
+                }
+                /* do not read beyond end of response */
+                if (space > count - sdp->rx.len)
+                        space = count - sdp->rx.len;
 
-                ret = select(fd + 1, &readfds, NULL, NULL, &timeout);
+                ret = sdp_wait_in(sdp, deadline, space);
                 if (ret <= 0) {
                         if (ret == 0)
                                 errno = ETIMEDOUT;
+                        sdp_rx_expire(&sdp->rx);
                         return SDP_ETIMEDOUT;
                 }
-                size_ = read(fd, buf, count);
-                if (size_ < 0)
+                size_ = read(sdp->f_in, rx_buf, space);
+                sdp->io.syscalls++;
+                if (sdp->wait == sdp_wait_vmin)
+                        sdp->io.wakeups++;
+                if (size_ <= 0) {
+                        if (size_ < 0 && errno == EAGAIN) {
+                                sdp->wait_ready = 0;
+                                continue;
+                        }
+                        if (size_ == 0)
+                                errno = EIO;
+                        sdp_rx_init(&sdp->rx);
                         return SDP_EERRNO;
-                size += size_;
-                count -= size_;
-                buf += size_;
-                if (sdp_resp(buf_, size) != sdp_resp_incomplete)
-                        return size;
-        } while (count > 0);
+                }
+                /* short read from tty means input queue is empty */
+                if (size_ < space)
+                        sdp->wait_ready = 0;
+                sdp_rx_commit(&sdp->rx, size_);
+        }
+        sdp->io.frames++;
+        /* arrival of next response raise new edge */
+        sdp->wait_ready = 0;
 
-        errno = ERANGE;
-        return SDP_ETOLARGE;
+        return ret;
 }
 
 /**
  * Write data into serial port. Return error when not all data
  *      succesfully writen.
- * @param fd    File descriptor.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
  * @param buf   Buffer with data to write.
  * @param count Maximal amout of bytes to write.
  * @return      Number of bytes succesfully writen, or negative number
  *      (error no.) on error.
  */
-static ssize_t sdp_write(int fd, char *buf, ssize_t count)
+static ssize_t sdp_write(sdp_t *sdp, char *buf, ssize_t count)
 {
         ssize_t count_;
 
-        count_ = write(fd, buf, count);
+        if (sdp->uring)
+                return sdp_uring_write(sdp, buf, count);
+
+        sdp->io.syscalls++;
+        count_ = write(sdp->f_out, buf, count);
         if (count_ >= 0 && count_ != count)
                 return SDP_EWINCOMPL;
 
         return count_;
 }
+
+/**
+ * Release resources of wait method.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+static void sdp_wait_close(sdp_t *sdp)
+{
+        if (sdp->wait_fd >= 0)
+                close(sdp->wait_fd);
+        sdp->wait_fd = -1;
+        sdp->wait_ready = 0;
+        sdp->wait_tio = -1;
+        sdp->wait = sdp_wait_select;
+}
+
+/**
+ * Attach port to io_uring requested by SDP_OPEN_URING, port stays with
+ *      its wait method when io_uring is not available.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param opts  Options of sdp_open_ex.
+ */
+static void sdp_uring_open(sdp_t *sdp, sdp_open_opts_t *opts)
+{
+        sdp_uring_t *ur = opts->uring;
+
+        if (!(opts->flags & SDP_OPEN_URING))
+                return;
+
+        if (!ur) {
+                ur = malloc(sizeof(*ur));
+                if (!ur)
+                        return;
+                if (sdp_uring_init(ur, 1) < 0) {
+                        free(ur);
+                        return;
+                }
+                sdp->uring_own = 1;
+        }
+        if (sdp_uring_add(ur, sdp) < 0) {
+                if (sdp->uring_own) {
+                        sdp_uring_close(ur);
+                        free(ur);
+                        sdp->uring_own = 0;
+                }
+                return;
+        }
+        opts->accepted |= SDP_OPEN_URING;
+}
+
+/**
+ * Detach port from io_uring.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+static void sdp_uring_release(sdp_t *sdp)
+{
+        sdp_uring_t *ur = sdp->uring;
+
+        if (!ur)
+                return;
+        sdp_uring_del(ur, sdp);
+        if (sdp->uring_own) {
+                sdp_uring_close(ur);
+                free(ur);
+                sdp->uring_own = 0;
+        }
+}
+
+/**
+ * Set method used to wait for response. Method sdp_wait_vmin switch f_in
+ *      into blocking mode, so handle with this method can not be used
+ *      by sdp_loop_t or sdp_async_t. Methods are bound to f_in, set
+ *      method again after f_in is changed.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param wait  Wait method.
+ * @return      On success 0, on error negative number (error no.),
+ *      sdp_wait_select is used on error.
+ */
+int sdp_set_wait(sdp_t *sdp, sdp_wait_t wait)
+{
+        int flags;
+
+        if (sdp->wait == sdp_wait_vmin) {
+                flags = fcntl(sdp->f_in, F_GETFL);
+                if (flags >= 0)
+                        fcntl(sdp->f_in, F_SETFL, flags | O_NONBLOCK);
+        }
+        sdp_wait_close(sdp);
+
+        switch (wait) {
+        case sdp_wait_select:
+        case sdp_wait_poll:
+                break;
+        case sdp_wait_epoll: {
+                struct epoll_event ev;
+
+                sdp->wait_fd = epoll_create1(EPOLL_CLOEXEC);
+                if (sdp->wait_fd < 0)
+                        return SDP_EERRNO;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLET;
+                if (epoll_ctl(sdp->wait_fd, EPOLL_CTL_ADD, sdp->f_in,
+                                        &ev) < 0) {
+                        int e = errno;
+
+                        sdp_wait_close(sdp);
+                        errno = e;
+                        return SDP_EERRNO;
+                }
+                /* data might be already waiting, edge was missed */
+                sdp->wait_ready = 1;
+                break;
+        }
+        case sdp_wait_vmin:
+                flags = fcntl(sdp->f_in, F_GETFL);
+                if (flags < 0 ||
+                        fcntl(sdp->f_in, F_SETFL, flags & ~O_NONBLOCK) < 0)
+                        return SDP_EERRNO;
+                break;
+        default:
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        sdp->wait = wait;
+
+        return 0;
+}
+
+/**
+ * Get value of monotonic clock, used to timestamp comunication.
+ * @return      Time [us].
+ */
+long long sdp_time_us(void)
+{
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+
+        return ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
 #endif
 
 #ifdef _WIN32
@@ -147,17 +459,22 @@ typedef int ssize_t;
 
 /**
  * Open serial port and set parameters as defined for SDP power source.
+ *      Optional settings which system refuses are not treated as error,
+ *      only not reported in opts->accepted.
  * @param fname File name of serial port.
+ * @param opts  Options, see sdp_open_ex.
  * @return      File descriptor on success, -1/INVALID_HANDLE_VALUE on error.
  */
 #ifdef _WIN32
-static HANDLE open_serial(const wchar_t *fname)
+static HANDLE open_serial(const wchar_t *fname, sdp_open_opts_t *opts)
 #else
-static HANDLE open_serial(const char *fname)
+static HANDLE open_serial(const char *fname, sdp_open_opts_t *opts)
 #endif
 {
         HANDLE h;
 
+        opts->accepted = 0;
+
         h = CreateFileW(fname, GENERIC_READ | GENERIC_WRITE, 0, 0,
                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
         if (h == INVALID_HANDLE_VALUE)
@@ -209,6 +526,13 @@ static HANDLE open_serial(const char *fname)
                 return INVALID_HANDLE_VALUE;
         }
 
+        /* port is always opened without sharing */
+        if (opts->flags & SDP_OPEN_EXCL)
+                opts->accepted |= SDP_OPEN_EXCL;
+
+        if ((opts->flags & SDP_OPEN_FLUSH) && PurgeComm(h, PURGE_RXCLEAR))
+                opts->accepted |= SDP_OPEN_FLUSH;
+
         return h;
 }
 
@@ -223,42 +547,71 @@ static void close_serial(HANDLE f)
 }
 
 /**
- * Read data from serial port.
- * @param h     File handle.
- * @param buf   Buffer to store readed data.
- * @param count Number of bytes to read.
+ * Read response from serial port. Data are recieved into framer of sdp,
+ *      bytes recieved after end of response are kept there for next call.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer to store readed response.
+ * @param count Lenght of expected response, longer response is rejected
+ *      as soon as it is recognized.
+ * @param exact 1 when count is exact lenght of response.
+ * @param timeout_us    Time to wait for response [us], not used yet.
  * @return      Number of bytes readed, or negative number (error no.)
  *      on error.
  */
-static ssize_t sdp_read_resp(HANDLE h, char *buf, ssize_t count)
+static ssize_t sdp_read_resp(sdp_t *sdp, char *buf, ssize_t count,
+                int exact, long timeout_us)
 {
         DWORD readb;
+        int ret;
 
         // TODO
-        if (!ReadFile(h, buf, count, &readb, NULL))
-                return SDP_EERRNO;
+        while (!(ret = sdp_rx_resp(&sdp->rx, buf, count, exact))) {
+                char *rx_buf;
+                int space;
+
+                space = sdp_rx_space(&sdp->rx, &rx_buf);
+                if (!space) {
+                        sdp_rx_init(&sdp->rx);
+                        errno = ERANGE;
+                        return SDP_ETOLARGE;
+                }
+                /* do not read beyond end of response */
+                if (space > count - sdp->rx.len)
+                        space = count - sdp->rx.len;
+
+                sdp->io.syscalls++;
+                sdp->io.wakeups++;
+                if (!ReadFile(sdp->f_in, rx_buf, space, &readb, NULL)) {
+                        sdp_rx_init(&sdp->rx);
+                        return SDP_EERRNO;
+                }
 
-	if (readb == 0) {
-		errno = EIO;
-		return SDP_ETIMEDOUT;
-	}
+                if (readb == 0) {
+                        sdp_rx_expire(&sdp->rx);
+                        errno = EIO;
+                        return SDP_ETIMEDOUT;
+                }
+                sdp_rx_commit(&sdp->rx, readb);
+        }
+        sdp->io.frames++;
 
-        return readb;
+        return ret;
 }
 
 /**
  * Write data into serial port.
- * @param h     File handle.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
  * @param buf   Buffer with data to send.
  * @param count Number of bytes to send.
  * @return      Number of bytes succesfully writen, or negative number
  *      (error no.) on error.
  */
-static ssize_t sdp_write(HANDLE h, char *buf, ssize_t count)
+static ssize_t sdp_write(sdp_t *sdp, char *buf, ssize_t count)
 {
         DWORD writeb;
 
-        if (!WriteFile(h, buf, count, &writeb, NULL))
+        sdp->io.syscalls++;
+        if (!WriteFile(sdp->f_out, buf, count, &writeb, NULL))
             return SDP_EERRNO;
 
         if (writeb != count)
@@ -266,69 +619,865 @@ static ssize_t sdp_write(HANDLE h, char *buf, ssize_t count)
 
         return writeb;
 }
+
+/**
+ * Release resources of wait method.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+static void sdp_wait_close(sdp_t *sdp)
+{
+        sdp->wait = sdp_wait_select;
+}
+
+/**
+ * Set method used to wait for response. ReadFile always waits by
+ *      timeouts of serial port, method is only stored.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param wait  Wait method.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_set_wait(sdp_t *sdp, sdp_wait_t wait)
+{
+        if (wait < sdp_wait_select || wait > sdp_wait_vmin) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        sdp->wait = wait;
+
+        return 0;
+}
+
+/**
+ * Get value of monotonic clock, used to timestamp comunication.
+ * @return      Time [us].
+ */
+long long sdp_time_us(void)
+{
+        LARGE_INTEGER cnt, freq;
+
+        QueryPerformanceFrequency(&freq);
+        QueryPerformanceCounter(&cnt);
+
+        return (cnt.QuadPart / freq.QuadPart) * 1000000ll +
+                (cnt.QuadPart % freq.QuadPart) * 1000000ll / freq.QuadPart;
+}
+#endif
+
+/**
+ * Initialize sdp_t structure.
+ * @param sdp   Pointer to uninitialized sdp_t structure.
+ * @param f     File descriptor or handle, depend on OS.
+ * @param addr  RS485 address of device.
+ */
+static void sdp_init(sdp_t *sdp, SDP_F f, int addr)
+{
+        sdp->f_in = sdp->f_out = f;
+        sdp->addr = addr;
+        sdp->wait = sdp_wait_select;
+        sdp->wait_fd = -1;
+        sdp->wait_ready = 0;
+        sdp->wait_tio = -1;
+        memset(&sdp->io, 0, sizeof(sdp->io));
+        sdp->mt = NULL;
+        sdp->coal = NULL;
+        sdp->uring = NULL;
+        sdp->uring_slot = 0;
+        sdp->uring_own = 0;
+        sdp->msdpd = 0;
+        sdp->msdpd_seq = 0;
+        sdp->shm = NULL;
+        sdp->shm_slot = 0;
+        sdp->changes = 0;
+        sdp_rx_init(&sdp->rx);
+        memset(sdp->rtt, 0, sizeof(sdp->rtt));
+        sdp_set_breaker(sdp, 0, 0, 0);
+        sdp->caps = NULL;
+        sdp->shadow.elided = 0;
+        sdp->shadow.coalesced = 0;
+        sdp_set_shadow(sdp, 0);
+        sdp->cache.hits = 0;
+        sdp->cache.misses = 0;
+        sdp_set_cache(sdp, 0, 0);
+}
+
+/**
+ * Open serial port to comunicate with SDP power supply.
+ * @param sdp   Pointer to uninitialized sdp_t structure.
+ * @param fname Name of serial port to open.
+ * @param addr  RS485 address of device, for RS232 is ignored - use anny valid.
+ * @return      On success 0, on error negative number (error no.).
+ */
+#ifdef _WIN32
+int sdp_open(sdp_t *sdp, const wchar_t *fname, int addr)
+#else
+int sdp_open(sdp_t *sdp, const char *fname, int addr)
+#endif
+{
+        return sdp_open_ex(sdp, fname, addr, NULL);
+}
+
+/**
+ * Open serial port to comunicate with SDP power supply, with aditional
+ *      options.
+ * @param sdp   Pointer to uninitialized sdp_t structure.
+ * @param fname Name of serial port to open.
+ * @param addr  RS485 address of device, for RS232 is ignored - use anny valid.
+ * @param opts  Requested options, on return opts->accepted contains
+ *      SDP_OPEN_* flags which system accepted. Might be NULL.
+ * @return      On success 0, on error negative number (error no.).
+ */
+#ifdef _WIN32
+int sdp_open_ex(sdp_t *sdp, const wchar_t *fname, int addr,
+                sdp_open_opts_t *opts)
+#else
+int sdp_open_ex(sdp_t *sdp, const char *fname, int addr,
+                sdp_open_opts_t *opts)
+#endif
+{
+        sdp_open_opts_t opts_;
+        SDP_F f;
+        int ret;
+
+        if (!opts) {
+                memset(&opts_, 0, sizeof(opts_));
+                opts = &opts_;
+        }
+
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        f = open_serial(fname, opts);
+        if (f == SDP_F_ERR)
+                return SDP_EERRNO;
+
+        sdp_init(sdp, f, addr);
+        if ( (ret = sdp_set_wait(sdp, opts->wait)) < 0) {
+                int e = errno;
+
+                close_serial(f);
+                errno = e;
+                return ret;
+        }
+#ifdef __linux__
+        sdp_uring_open(sdp, opts);
+#endif
+
+        return 0;
+}
+
+/**
+ * Initialize sdp usign existing opened file.
+ * @param sdp   Pointer to uninitialized sdp_t structure.
+ * @param f     File descriptor or handle, depend on OS.
+ * @param addr  RS485 address of device, for RS232 is ignored - use anny valid.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_openf(sdp_t *sdp, SDP_F f, int addr)
+{
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
+                errno = ERANGE;
+                return SDP_EERRNO;
+        }
+
+        sdp_init(sdp, f, addr);
+
+        return 0;
+}
+
+/**
+ * Close SDP and all asociated ports.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+void sdp_close(sdp_t *sdp)
+{
+#ifdef __linux__
+        sdp_mt_stop(sdp);
+        sdp_coal_stop(sdp);
+        sdp_uring_release(sdp);
+#endif
+        sdp_wait_close(sdp);
+        close_serial(sdp->f_in);
+        if (sdp->f_in != sdp->f_out)
+                close_serial(sdp->f_out);
+}
+
+
+/**
+ * Get time to wait for response from device. Until round trip time of
+ *      command is known, timeout is derived from lenght of response,
+ *      later from estimated round trip time. Timeout is never longer than
+ *      the one derived from lenght of response.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param op    Command waiting for response.
+ * @param count Maximal lenght of response.
+ * @return      Response timeout [us].
+ */
+long sdp_resp_timeout(sdp_t *sdp, sdp_op_t op, int count)
+{
+        const sdp_rtt_t *rtt = &sdp->rtt[op];
+        long timeout, timeout_max;
+
+        // (bytes * 10 * usec) / bitrate + delay_to_reaction;
+        timeout_max = (count * 10l * 1000000l) / 9600l + SDP_REACT_TIME;
+        if (!rtt->samples)
+                return timeout_max;
+
+        timeout = 4 * rtt->rttvar;
+        if (timeout < SDP_RTT_MARGIN)
+                timeout = SDP_RTT_MARGIN;
+        timeout += rtt->srtt;
+
+        return (timeout < timeout_max) ? timeout : timeout_max;
+}
+
+/**
+ * Update round trip time estimate of command by result of exchange.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param op    Command which was send.
+ * @param ret   Result of exchange, lenght of response or negative number
+ *      (error no.).
+ * @param rtt   Time elapsed from sending command to recieving
+ *      response [us].
+ */
+void sdp_rtt_update(sdp_t *sdp, sdp_op_t op, int ret, long rtt)
+{
+        sdp_rtt_t *est = &sdp->rtt[op];
+        long delta;
+
+        if (ret == SDP_ETIMEDOUT) {
+                /* device might be slower than expected, extend timeout */
+                est->timeouts++;
+                est->rttvar += est->rttvar / 2;
+                return;
+        }
+        if (ret < 0)
+                return;
+
+        if (!est->samples++) {
+                est->srtt = rtt;
+                est->rttvar = rtt / 2;
+                return;
+        }
+
+        delta = est->srtt - rtt;
+        if (delta < 0)
+                delta = -delta;
+        est->rttvar += (delta - est->rttvar) / 4;
+        est->srtt += (rtt - est->srtt) / 8;
+}
+
+/**
+ * Get round trip time estimate of command.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param op    Command.
+ * @param rtt   Pointer to sdp_rtt_t used to store estimate.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_get_rtt(sdp_t *sdp, sdp_op_t op, sdp_rtt_t *rtt)
+{
+        if (op < 0 || op >= sdp_op_count) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        *rtt = sdp->rtt[op];
+
+        return 0;
+}
+
+/**
+ * Initialize circuit breaker in closed state.
+ * @param breaker       Pointer to sdp_breaker_t structure.
+ * @param threshold     Number of consecutive timeouts or invalid responses
+ *      which opens breaker, 0 disables breaker.
+ * @param backoff_min   Time device is not probed after breaker opens [us].
+ * @param backoff_max   Longest time between probes [us].
+ */
+void sdp_breaker_init(sdp_breaker_t *breaker, int threshold, long backoff_min,
+                long backoff_max)
+{
+        memset(breaker, 0, sizeof(*breaker));
+        breaker->threshold = threshold;
+        breaker->backoff_min = backoff_min;
+        breaker->backoff_max = (backoff_max < backoff_min) ?
+                backoff_min : backoff_max;
+        breaker->state = sdp_breaker_closed;
+}
+
+/**
+ * Check whatever request might be send to device.
+ * @param breaker       Pointer to sdp_breaker_t structure.
+ * @return      0 when request might be send, 1 when device should be
+ *      probed first, SDP_EDEVDOWN (errno EHOSTDOWN) when request must be
+ *      rejected.
+ */
+int sdp_breaker_allow(sdp_breaker_t *breaker)
+{
+        long long now;
+
+        if (!breaker->threshold || breaker->state == sdp_breaker_closed)
+                return 0;
+
+        now = sdp_time_us();
+        if (breaker->state == sdp_breaker_open && now < breaker->retry) {
+                breaker->rejects++;
+                errno = EHOSTDOWN;
+                return SDP_EDEVDOWN;
+        }
+        breaker->state = sdp_breaker_half_open;
+        breaker->changed = now;
+        breaker->probes++;
+
+        return 1;
+}
+
+/**
+ * Update circuit breaker by result of exchange with device.
+ * @param breaker       Pointer to sdp_breaker_t structure.
+ * @param ret   Result of exchange, lenght of response or negative number
+ *      (error no.).
+ */
+void sdp_breaker_update(sdp_breaker_t *breaker, int ret)
+{
+        long long now;
+
+        if (!breaker->threshold)
+                return;
+
+        if (ret >= 0) {
+                breaker->fails = 0;
+                if (breaker->state != sdp_breaker_closed) {
+                        breaker->state = sdp_breaker_closed;
+                        breaker->changed = sdp_time_us();
+                        breaker->closes++;
+                }
+                return;
+        }
+        /* only silent or garbling device is failing, not local errors */
+        if (ret != SDP_ETIMEDOUT && ret != SDP_EINRES)
+                return;
+
+        breaker->fails++;
+        if (breaker->state == sdp_breaker_half_open) {
+                breaker->backoff *= 2;
+                if (breaker->backoff > breaker->backoff_max)
+                        breaker->backoff = breaker->backoff_max;
+        } else if (breaker->state == sdp_breaker_closed &&
+                        breaker->fails >= breaker->threshold) {
+                breaker->backoff = breaker->backoff_min;
+        } else {
+                return;
+        }
+
+        now = sdp_time_us();
+        breaker->state = sdp_breaker_open;
+        breaker->changed = now;
+        breaker->retry = now + breaker->backoff;
+        breaker->opens++;
+}
+
+/**
+ * Configure circuit breakers of all device addresses, breakers are reset
+ *      to closed state.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param threshold     Number of consecutive timeouts or invalid responses
+ *      which opens breaker, 0 disables breakers.
+ * @param backoff_min   Time device is not probed after breaker opens [us].
+ * @param backoff_max   Longest time between probes [us].
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_set_breaker(sdp_t *sdp, int threshold, long backoff_min,
+                long backoff_max)
+{
+        int addr;
+
+        if (threshold < 0 || backoff_min < 0) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        for (addr = 0; addr <= SDP_DEV_ADDR_MAX; addr++)
+                sdp_breaker_init(&sdp->breaker[addr], threshold, backoff_min,
+                                backoff_max);
+
+        return 0;
+}
+
+/**
+ * Get state of circuit breaker of device.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param addr  Device address.
+ * @param breaker       Pointer to sdp_breaker_t used to store state.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_get_breaker(sdp_t *sdp, int addr, sdp_breaker_t *breaker)
+{
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        *breaker = sdp->breaker[addr];
+
+        return 0;
+}
+
+/**
+ * Enable or disable setpoint shadow. With shadow enabled setpoint write
+ *      (VOLT, CURR) of value device already acknowledged is not send and
+ *      setpoint write queued as last one (thread-safe mode, event loop) is
+ *      replaced by newer write of the same setpoint. Shadow is reset to unknown
+ *      values, setpoint changed on front panel is not detected, so it
+ *      should be used in remote mode only.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param enable        1 to enable shadow, 0 to disable it.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_set_shadow(sdp_t *sdp, int enable)
+{
+        int addr;
+
+        for (addr = 0; addr <= SDP_DEV_ADDR_MAX; addr++) {
+                sdp->shadow.volt[addr] = -1;
+                sdp->shadow.curr[addr] = -1;
+        }
+        sdp->shadow.enabled = enable ? 1 : 0;
+
+        return 0;
+}
+
+/**
+ * Check whatever command might be skipped, because device holds setpoint
+ *      already. Device with breaker which is not closed is never skipped.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      1 when command should not be send and "OK\r" response
+ *      should be used instead, 0 when command must be send.
+ */
+int sdp_shadow_check(sdp_t *sdp, const char *buf, int len)
+{
+        int addr, val;
+        int *shadow;
+
+        if (!sdp->shadow.enabled)
+                return 0;
+        if ( (val = sdp_cmd_setpoint(buf, len)) < 0)
+                return 0;
+
+        addr = sdp_cmd_addr(buf, len);
+        if (sdp->breaker[addr].state != sdp_breaker_closed)
+                return 0;
+        shadow = (sdp_op_id(buf, len) == sdp_op_volt) ?
+                sdp->shadow.volt : sdp->shadow.curr;
+        if (shadow[addr] != val)
+                return 0;
+
+        sdp->shadow.elided++;
+
+        return 1;
+}
+
+/**
+ * Update setpoint shadow by result of exchange. Acknowledged setpoint
+ *      write is stored, failed write and commands which change setpoints
+ *      (presets, programs, end of remote session) make shadow of device
+ *      unknown.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @param ret   Result of exchange, lenght of response or negative number
+ *      (error no.).
+ */
+void sdp_shadow_update(sdp_t *sdp, const char *buf, int len, int ret)
+{
+        int addr, val;
+
+        if (!sdp->shadow.enabled)
+                return;
+
+        addr = sdp_cmd_addr(buf, len);
+        switch (sdp_op_id(buf, len)) {
+        case sdp_op_volt:
+                val = sdp_cmd_setpoint(buf, len);
+                sdp->shadow.volt[addr] = (ret < 0) ? -1 : val;
+                break;
+        case sdp_op_curr:
+                val = sdp_cmd_setpoint(buf, len);
+                sdp->shadow.curr[addr] = (ret < 0) ? -1 : val;
+                break;
+        case sdp_op_ends:
+        case sdp_op_ccom:
+        case sdp_op_runm:
+        case sdp_op_runp:
+        case sdp_op_stop:
+                sdp->shadow.volt[addr] = -1;
+                sdp->shadow.curr[addr] = -1;
+                break;
+        default:
+                break;
+        }
+}
+
+/**
+ * Get counters of setpoint shadow. Counters are updated by thread which
+ *      exchanges data with device, in thread-safe mode call this function
+ *      from callback of request submitted by sdp_mt_submit or after
+ *      sdp_mt_stop.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param elided        Used to store number of writes not send, or NULL.
+ * @param coalesced     Used to store number of queued writes replaced by
+ *      newer ones, or NULL.
+ */
+void sdp_get_shadow_stats(sdp_t *sdp, unsigned long *elided,
+                unsigned long *coalesced)
+{
+        if (elided)
+                *elided = sdp->shadow.elided;
+        if (coalesced)
+                *coalesced = sdp->shadow.coalesced;
+}
+
+/**
+ * Get index of cached read in sdp_cache_t entry array.
+ * @param op    Command identification.
+ * @return      Index of read, -1 when read is not cached.
+ */
+static int sdp_cache_idx(sdp_op_t op)
+{
+        switch (op) {
+        case sdp_op_gcom:
+                return 0;
+        case sdp_op_gmax:
+                return 1;
+        case sdp_op_govp:
+                return 2;
+        default:
+                return -1;
+        }
+}
+
+/**
+ * Enable or disable cache of reads which values change only by commands of
+ *      this library (GCOM, GMAX, GOVP), cache is emptied. Responses are
+ *      dropped when library sends SOVP or CCOM to device, by
+ *      sdp_cache_invalidate and when ttl expires.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param enable        1 to enable cache, 0 to disable it.
+ * @param ttl   Time cached response stays valid [us], 0 for unlimited.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_set_cache(sdp_t *sdp, int enable, long ttl)
+{
+        if (ttl < 0) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        sdp_cache_invalidate(sdp);
+        sdp->cache.ttl = ttl;
+        sdp->cache.enabled = enable ? 1 : 0;
+
+        return 0;
+}
+
+/**
+ * Drop all cached responses, next reads are send to device. Use it when
+ *      device was changed by other means than this library (front panel,
+ *      other application).
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+void sdp_cache_invalidate(sdp_t *sdp)
+{
+        int addr, idx;
+
+        for (addr = 0; addr <= SDP_DEV_ADDR_MAX; addr++) {
+                for (idx = 0; idx < SDP_CACHE_OPS; idx++)
+                        sdp->cache.entry[addr][idx].len = 0;
+        }
+}
+
+/**
+ * Get cached response on command. Device with breaker which is not closed
+ *      is never served from cache.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @param resp  Buffer used to store response, might be the same as buf.
+ * @param size  Size of resp.
+ * @return      Lenght of response, 0 when command must be send to device.
+ */
+int sdp_cache_get(sdp_t *sdp, const char *buf, int len, char *resp,
+                int size)
+{
+        sdp_cache_entry_t *entry;
+        int addr, idx;
+
+        if (!sdp->cache.enabled)
+                return 0;
+        if ( (idx = sdp_cache_idx(sdp_op_id(buf, len))) < 0)
+                return 0;
+
+        addr = sdp_cmd_addr(buf, len);
+        entry = &sdp->cache.entry[addr][idx];
+        if (!entry->len || entry->len > size ||
+                        sdp->breaker[addr].state != sdp_breaker_closed ||
+                        (sdp->cache.ttl &&
+                         sdp_time_us() - entry->stamp > sdp->cache.ttl)) {
+                sdp->cache.misses++;
+                return 0;
+        }
+
+        memcpy(resp, entry->resp, entry->len);
+        sdp->cache.hits++;
+
+        return entry->len;
+}
+
+/**
+ * Update cache by result of exchange. Valid response of cached read is
+ *      stored, SOVP drops cached voltage limit and CCOM drops all responses
+ *      of device (even when exchange failed, command might be processed).
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @param resp  Buffer with response.
+ * @param ret   Result of exchange, lenght of response or negative number
+ *      (error no.).
+ */
+void sdp_cache_update(sdp_t *sdp, const char *buf, int len,
+                const char *resp, int ret)
+{
+        sdp_cache_entry_t *entry;
+        sdp_op_t op;
+        int addr, idx;
+
+        if (!sdp->cache.enabled)
+                return;
+
+        addr = sdp_cmd_addr(buf, len);
+        op = sdp_op_id(buf, len);
+        switch (op) {
+        case sdp_op_sovp:
+                sdp->cache.entry[addr][sdp_cache_idx(sdp_op_govp)].len = 0;
+                return;
+        case sdp_op_ccom:
+                for (idx = 0; idx < SDP_CACHE_OPS; idx++)
+                        sdp->cache.entry[addr][idx].len = 0;
+                return;
+        default:
+                break;
+        }
+
+        if ( (idx = sdp_cache_idx(op)) < 0)
+                return;
+        entry = &sdp->cache.entry[addr][idx];
+        /* only complete response is cached */
+        if (ret != sdp_op_resp_len(op)) {
+                entry->len = 0;
+                return;
+        }
+        memcpy(entry->resp, resp, ret);
+        entry->len = ret;
+        entry->stamp = sdp_time_us();
+}
+
+/**
+ * Get counters of cache. Counters are updated by thread which exchanges
+ *      data with device, in thread-safe mode call this function from
+ *      callback of request submitted by sdp_mt_submit or after sdp_mt_stop.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param hits  Used to store number of reads served from cache, or NULL.
+ * @param misses        Used to store number of cacheable reads send to
+ *      device, or NULL.
+ */
+void sdp_get_cache_stats(sdp_t *sdp, unsigned long *hits,
+                unsigned long *misses)
+{
+        if (hits)
+                *hits = sdp->cache.hits;
+        if (misses)
+                *misses = sdp->cache.misses;
+}
+
+/**
+ * Count command which might change state of device, see sdp_adapt_t.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+static void sdp_changed(sdp_t *sdp)
+{
+#ifdef __linux__
+        /* in thread-safe mode counter is read by other thread */
+        __atomic_fetch_add(&sdp->changes, 1, __ATOMIC_RELAXED);
+#else
+        sdp->changes++;
 #endif
+}
 
 /**
- * Open serial port to comunicate with SDP power supply.
- * @param sdp   Pointer to uninitialized sdp_t structure.
- * @param fname Name of serial port to open.
- * @param addr  RS485 address of device, for RS232 is ignored - use anny valid.
- * @return      On success 0, on error negative number (error no.).
+ * Send command to device and recieve response on calling thread.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error.
  */
-#ifdef _WIN32
-int sdp_open(sdp_t *sdp, const wchar_t *fname, int addr)
-#else
-int sdp_open(sdp_t *sdp, const char *fname, int addr)
-#endif
+static int sdp_xfer_wire(sdp_t *sdp, char *buf, int len, int size)
 {
-        SDP_F f;
+        long long start;
+        int exact = 0;
+        sdp_op_t op;
+        int ret;
 
-        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
-                errno = ERANGE;
-                return SDP_ERANGE;
+#ifdef __linux__
+        if (sdp->msdpd)
+                return sdp_msdpd_xfer(sdp, buf, len, size);
+#endif
+        op = sdp_op_id(buf, len);
+        if (sdp_op_resp_len(op) && sdp_op_resp_len(op) <= size) {
+                size = sdp_op_resp_len(op);
+                exact = 1;
         }
+        start = sdp_time_us();
 
-        f = open_serial(fname);
-        if (f == SDP_F_ERR)
-                return SDP_EERRNO;
+        if ( (ret = sdp_write(sdp, buf, len)) < 0)
+                return ret;
 
-        sdp->f_in = sdp->f_out = f;
-        sdp->addr = addr;
+        ret = sdp_read_resp(sdp, buf, size, exact,
+                        sdp_resp_timeout(sdp, op, size));
+        sdp_rtt_update(sdp, op, ret, sdp_time_us() - start);
 
-        return 0;
+        return ret;
 }
 
 /**
- * Initialize sdp usign existing opened file.
- * @param sdp   Pointer to uninitialized sdp_t structure.
- * @param f     File descriptor or handle, depend on OS.
- * @param addr  RS485 address of device, for RS232 is ignored - use anny valid.
- * @return      On success 0, on error negative number (error no.).
+ * Send command to device and recieve response on calling thread, device
+ *      which does not respond is skipped by its circuit breaker.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error.
  */
-int sdp_openf(sdp_t *sdp, SDP_F f, int addr)
+static int sdp_xfer_raw(sdp_t *sdp, char *buf, int len, int size)
 {
-        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
-                errno = ERANGE;
-                return SDP_EERRNO;
+        sdp_breaker_t *breaker;
+        char probe[SDP_BUF_SIZE_MIN];
+        char cmd[SDP_BUF_SIZE_MIN];
+        int addr, cmd_len, ret;
+
+        if ( (ret = sdp_caps_check_cmd(sdp->caps, buf, len)) < 0)
+                return ret;
+        if (sdp_cmd_class(buf, len) <= sdp_class_control) {
+                if (sdp_shadow_check(sdp, buf, len) &&
+                                size >= SDP_RESP_LEN_OK) {
+                        memcpy(buf, "OK\r", SDP_RESP_LEN_OK);
+                        return SDP_RESP_LEN_OK;
+                }
+                /* state of device might be changed, see sdp_adapt_t */
+                sdp_changed(sdp);
+        }
+        if ( (ret = sdp_cache_get(sdp, buf, len, buf, size)) > 0)
+                return ret;
+        /* command is overwritten by response */
+        cmd_len = ((sdp->shadow.enabled || sdp->cache.enabled) &&
+                        len <= (int)sizeof(cmd)) ? len : 0;
+        memcpy(cmd, buf, cmd_len);
+
+        addr = sdp_cmd_addr(buf, len);
+        breaker = &sdp->breaker[addr];
+        if ( (ret = sdp_breaker_allow(breaker)) < 0)
+                return ret;
+        /* device might be still off, probe it by short GCOM first */
+        if (ret && addr && sdp_op_id(buf, len) != sdp_op_gcom) {
+                if ( (ret = sdp_sget_dev_addr(probe, addr)) < 0)
+                        return ret;
+                ret = sdp_xfer_wire(sdp, probe, ret, sizeof(probe));
+                sdp_breaker_update(breaker, ret);
+                if (ret < 0)
+                        return ret;
         }
 
-        sdp->f_in = sdp->f_out = f;
-        sdp->addr = addr;
+        ret = sdp_xfer_wire(sdp, buf, len, size);
+        sdp_breaker_update(breaker, ret);
+        sdp_shadow_update(sdp, cmd, cmd_len, ret);
+        sdp_cache_update(sdp, cmd, cmd_len, buf, ret);
 
-        return 0;
+        return ret;
 }
 
 /**
- * Close SDP and all asociated ports.
+ * Send command to device and recieve response, in thread-safe mode
+ *      exchange is passed to owner thread.
  * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error.
  */
-void sdp_close(sdp_t *sdp)
+static int sdp_xfer_dev(sdp_t *sdp, char *buf, int len, int size)
 {
-        close_serial(sdp->f_in);
-        if (sdp->f_in != sdp->f_out)
-                close_serial(sdp->f_out);
+#ifdef __linux__
+        if (sdp->mt)
+                return sdp_mt_xfer(sdp, buf, len, size);
+#endif
+        return sdp_xfer_raw(sdp, buf, len, size);
+}
+
+/**
+ * Send command to device and recieve response, identical reads are
+ *      coalesced when enabled by sdp_coal_start.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+static int sdp_xfer(sdp_t *sdp, char *buf, int len, int size)
+{
+#ifdef __linux__
+        int ret;
+
+        if (sdp->coal) {
+                if (sdp_coal_op(sdp_op_id(buf, len)))
+                        return sdp_coal_xfer(sdp, buf, len, size,
+                                        sdp_xfer_dev);
+                ret = sdp_xfer_dev(sdp, buf, len, size);
+                /* results of reads might be changed by command */
+                sdp_coal_invalidate(sdp);
+                return ret;
+        }
+#endif
+        return sdp_xfer_dev(sdp, buf, len, size);
 }
 
+/**
+ * Process request synchronously on calling thread. This function is not
+ *      thread-safe, it is used by event driven interfaces to execute
+ *      queued requests.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param req   Request with prepared command, result is stored in req->ret,
+ *      req->err and req->resp.
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+int sdp_req_run(sdp_t *sdp, sdp_req_t *req)
+{
+        int ret;
+
+        if (req->cmd_len > (int)sizeof(req->cmd)) {
+                errno = ERANGE;
+                ret = SDP_ETOLARGE;
+        } else {
+                memcpy(req->resp, req->cmd, req->cmd_len);
+                ret = sdp_xfer_raw(sdp, req->resp, req->cmd_len,
+                                sizeof(req->resp));
+        }
+        req->ret = ret;
+        req->err = (ret < 0) ? errno : 0;
+
+        return ret;
+}
 
 /**
  * Get SDP device address. For devices connected on RS485 this returns
@@ -337,7 +1486,7 @@ void sdp_close(sdp_t *sdp)
  * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
  * @return      SDP device address, or negative number (error no.) on error.
  */
-int sdp_get_dev_addr(const sdp_t *sdp)
+int sdp_get_dev_addr(sdp_t *sdp)
 {
         int addr, ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -345,13 +1494,53 @@ int sdp_get_dev_addr(const sdp_t *sdp)
         if ( (ret = sdp_sget_dev_addr(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_resp_dev_addr(buf, ret, &addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_resp_dev_addr(buf, ret, &addr)) < 0)
+        return addr;
+}
+
+/**
+ * Probe whatever device with address responds, used to scan RS485 bus. Only
+ *      GCOM is exchanged with short timeout, response of missing device is
+ *      not waited for as long as by sdp_get_dev_addr.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param addr  Address of probed device.
+ * @param timeout       Response timeout [us], 0 to derive it from lenght of
+ *      GCOM command and response.
+ * @return      Address reported by device (differs from addr for device
+ *      connected by RS232), or negative number (error no.) on error.
+ */
+int sdp_probe(sdp_t *sdp, int addr, long timeout)
+{
+        int len, ret;
+        char buf[SDP_BUF_SIZE_MIN];
+
+        /* exchange with explicit timeout can not be passed to owner thread
+         * or msdpd */
+        if (sdp->mt || sdp->msdpd) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+
+        if ( (len = sdp_sget_dev_addr(buf, addr)) < 0)
+                return len;
+
+        ret = sdp_op_resp_len(sdp_op_gcom);
+        if (timeout <= 0)
+                timeout = ((len + ret) * 10l * 1000000l) / 9600l +
+                        SDP_RTT_MARGIN;
+
+        if ( (len = sdp_write(sdp, buf, len)) < 0)
+                return len;
+
+        if ( (len = sdp_read_resp(sdp, buf, ret, 1, timeout)) < 0)
+                return len;
+
+        if ( (ret = sdp_resp_dev_addr(buf, len, &addr)) < 0)
                 return ret;
 
         return addr;
@@ -363,18 +1552,21 @@ int sdp_get_dev_addr(const sdp_t *sdp)
  * @param va_maximums   Pointer to sdp_va_t, used to store recieved values.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_va_maximums(const sdp_t *sdp, sdp_va_t *va_maximums)
+int sdp_get_va_maximums(sdp_t *sdp, sdp_va_t *va_maximums)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
 
-        if ( (ret = sdp_sget_va_maximums(buf, sdp->addr)) < 0)
-                return ret;
+        /* maximums of identified model are known */
+        if (sdp->caps) {
+                *va_maximums = sdp->caps->va_maximums;
+                return 0;
+        }
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
+        if ( (ret = sdp_sget_va_maximums(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_va_maximums(buf, ret, va_maximums)) < 0)
@@ -383,13 +1575,56 @@ int sdp_get_va_maximums(const sdp_t *sdp, sdp_va_t *va_maximums)
         return 0;
 }
 
+/**
+ * Set model of device, setpoints are then checked against its limits before
+ *      anything is send and sdp_get_va_maximums does not ask device.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param model Model of device, sdp_model_unknown to check only generic
+ *      ranges.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_set_model(sdp_t *sdp, sdp_model_t model)
+{
+        if (model < sdp_model_unknown || model >= sdp_model_count) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        sdp->caps = sdp_model_caps(model);
+
+        return 0;
+}
+
+/**
+ * Identify model of device by GMAX and set it by sdp_set_model. Use
+ *      sdp_set_model with model stored before (see sdp_disc_attach) to
+ *      avoid this exchange.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @return      Identified model (sdp_model_unknown when not known), or
+ *      negative number (error no.) on error.
+ */
+int sdp_identify(sdp_t *sdp)
+{
+        sdp_va_t va_maximums;
+        int ret;
+
+        sdp->caps = NULL;
+        if ( (ret = sdp_get_va_maximums(sdp, &va_maximums)) < 0)
+                return ret;
+
+        ret = sdp_model_identify(&va_maximums);
+        sdp->caps = sdp_model_caps(ret);
+
+        return ret;
+}
+
 /**
  * Get upper voltage limit.
  * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
  * @param volt  pointer to double, uset to store retrieved value.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_volt_limit(const sdp_t *sdp, double *volt)
+int sdp_get_volt_limit(sdp_t *sdp, double *volt)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -397,10 +1632,7 @@ int sdp_get_volt_limit(const sdp_t *sdp, double *volt)
         if ( (ret = sdp_sget_volt_limit(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_volt_limit(buf, ret, volt)) < 0)
@@ -415,7 +1647,7 @@ int sdp_get_volt_limit(const sdp_t *sdp, double *volt)
  * @param va_data       pointer to sdp_va_data_t, used to store returned values.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_va_data(const sdp_t *sdp, sdp_va_data_t *va_data)
+int sdp_get_va_data(sdp_t *sdp, sdp_va_data_t *va_data)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -423,15 +1655,17 @@ int sdp_get_va_data(const sdp_t *sdp, sdp_va_data_t *va_data)
         if ( (ret = sdp_sget_va_data(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_va_data(buf, ret, va_data)) < 0)
                 return ret;
 
+#ifdef __linux__
+        if (sdp->shm)
+                sdp_shm_put(sdp, SDP_SHM_VA_DATA, va_data);
+#endif
+
         return 0;
 }
 
@@ -442,7 +1676,7 @@ int sdp_get_va_data(const sdp_t *sdp, sdp_va_data_t *va_data)
  *      values.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_va_setpoint(const sdp_t *sdp, sdp_va_t *va_setpoints)
+int sdp_get_va_setpoint(sdp_t *sdp, sdp_va_t *va_setpoints)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -450,15 +1684,17 @@ int sdp_get_va_setpoint(const sdp_t *sdp, sdp_va_t *va_setpoints)
         if ( (ret = sdp_sget_va_setpoint(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_va_setpoint(buf, ret, va_setpoints)) < 0)
                 return ret;
 
+#ifdef __linux__
+        if (sdp->shm)
+                sdp_shm_put(sdp, SDP_SHM_SETPOINT, va_setpoints);
+#endif
+
         return 0;
 }
 
@@ -471,7 +1707,7 @@ int sdp_get_va_setpoint(const sdp_t *sdp, sdp_va_t *va_setpoints)
  *      or pointer to first item of array of 9 sdp_va_t, to store all presets.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_preset(const sdp_t *sdp, int presn, sdp_va_t *va_preset)
+int sdp_get_preset(sdp_t *sdp, int presn, sdp_va_t *va_preset)
 {
         int ret;
         char buf[(7*9+3+1)];
@@ -479,10 +1715,7 @@ int sdp_get_preset(const sdp_t *sdp, int presn, sdp_va_t *va_preset)
         if ( (ret = sdp_sget_preset(buf, sdp->addr, presn)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_preset(buf, ret, va_preset)) < 0)
@@ -501,7 +1734,7 @@ int sdp_get_preset(const sdp_t *sdp, int presn, sdp_va_t *va_preset)
  *      store all program items.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_program(const sdp_t *sdp, int progn, sdp_program_t *program)
+int sdp_get_program(sdp_t *sdp, int progn, sdp_program_t *program)
 {
         int ret;
         char buf[11*20+3+1];
@@ -509,10 +1742,7 @@ int sdp_get_program(const sdp_t *sdp, int progn, sdp_program_t *program)
         if ( (ret = sdp_sget_program(buf, sdp->addr, progn)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_program(buf, ret, program)) < 0)
@@ -528,7 +1758,7 @@ int sdp_get_program(const sdp_t *sdp, int progn, sdp_program_t *program)
  *      should be stored.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_get_lcd_info(const sdp_t *sdp, sdp_lcd_info_t *lcd_info)
+int sdp_get_lcd_info(sdp_t *sdp, sdp_lcd_info_t *lcd_info)
 {
         int ret;
         char buf[100];
@@ -537,10 +1767,7 @@ int sdp_get_lcd_info(const sdp_t *sdp, sdp_lcd_info_t *lcd_info)
         if ( (ret = sdp_sget_lcd_info(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, sizeof(buf))) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, sizeof(buf))) < 0)
                 return ret;
 
         if ( (ret = sdp_resp_lcd_info(buf, ret, &lcd_info_raw)) < 0)
@@ -548,6 +1775,186 @@ int sdp_get_lcd_info(const sdp_t *sdp, sdp_lcd_info_t *lcd_info)
 
 	sdp_lcd_to_data(lcd_info, &lcd_info_raw);
 
+#ifdef __linux__
+        if (sdp->shm)
+                sdp_shm_put(sdp, SDP_SHM_LCD_INFO, lcd_info);
+#endif
+
+        return 0;
+}
+
+/**
+ * Send one read of query and store fields it provides. Fields are stored
+ *      only into structures which are not NULL.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param op    Read to send, one of reads chosen by sdp_query_plan.
+ * @param va_data       Used to store measured values, or NULL.
+ * @param va_setpoints  Used to store setpoints, or NULL.
+ * @param lcd_info      Used to store panel state, or NULL.
+ * @return      Mask of SDP_FIELD_* values stored, or negative number
+ *      (error no.) on error.
+ */
+static int sdp_query_op(sdp_t *sdp, sdp_op_t op, sdp_va_data_t *va_data,
+                sdp_va_t *va_setpoints, sdp_lcd_info_t *lcd_info)
+{
+        sdp_lcd_info_t lcd_tmp;
+        sdp_va_data_t va_data_tmp;
+        sdp_va_t va_tmp;
+        int ret, valid;
+
+        switch (op) {
+        case sdp_op_getd:
+                if (!va_data)
+                        va_data = &va_data_tmp;
+                if ( (ret = sdp_get_va_data(sdp, va_data)) < 0)
+                        return ret;
+                valid = SDP_FIELD_VA_DATA;
+                break;
+        case sdp_op_gets:
+                if (!va_setpoints)
+                        va_setpoints = &va_tmp;
+                if ( (ret = sdp_get_va_setpoint(sdp, va_setpoints)) < 0)
+                        return ret;
+                valid = SDP_FIELD_SETPOINT;
+                break;
+        case sdp_op_gpal:
+                if (!lcd_info)
+                        lcd_info = &lcd_tmp;
+                if ( (ret = sdp_get_lcd_info(sdp, lcd_info)) < 0)
+                        return ret;
+                valid = SDP_FIELD_ALL;
+                if (lcd_info == &lcd_tmp)
+                        valid &= ~SDP_FIELD_LCD_INFO;
+                /* panel shows all values, copy them to other structures */
+                if (va_data) {
+                        va_data->volt = lcd_info->read_V;
+                        va_data->curr = lcd_info->read_A;
+                        va_data->mode = lcd_info->set_A_const ?
+                                sdp_mode_cc : sdp_mode_cv;
+                } else {
+                        valid &= ~SDP_FIELD_VA_DATA;
+                }
+                if (va_setpoints) {
+                        va_setpoints->volt = lcd_info->set_V;
+                        va_setpoints->curr = lcd_info->set_A;
+                } else {
+                        valid &= ~SDP_FIELD_SETPOINT;
+                }
+                break;
+        default:
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        return valid;
+}
+
+/**
+ * Choose reads of query, reads are compared by measured round trip time,
+ *      read which was not measured yet by its estimate (see sdp_op_cost).
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param fields        Mask of requested SDP_FIELD_* values.
+ * @param ops   Used to store reads in order they should be send.
+ * @return      Number of reads stored in ops, or negative number
+ *      (error no.) on error.
+ */
+static int sdp_query_ops(sdp_t *sdp, unsigned int fields,
+                sdp_op_t ops[SDP_QUERY_OPS_MAX])
+{
+        long cost[sdp_op_count];
+        int op;
+
+        /* read not chosen by plan is never measured */
+        for (op = 0; op < sdp_op_count; op++) {
+                if (!sdp_op_fields(op))
+                        continue;
+                cost[op] = sdp->rtt[op].samples ? sdp->rtt[op].srtt :
+                        sdp_op_cost(op);
+        }
+
+        return sdp_query_plan(fields, cost, ops);
+}
+
+/**
+ * Get fields of device state by the cheapest set of reads. For example
+ *      measured values are read by short GETD, but measured values with
+ *      output state are read by single GPAL instead of GETD and GPAL.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param fields        Mask of requested SDP_FIELD_* values.
+ * @param va_data       Used to store SDP_FIELD_VA_DATA fields, might be NULL
+ *      when none of them is requested.
+ * @param va_setpoints  Used to store SDP_FIELD_SETPOINT fields, might be
+ *      NULL when none of them is requested.
+ * @param lcd_info      Used to store SDP_FIELD_LCD_INFO fields, might be
+ *      NULL when none of them is requested.
+ * @return      Mask of SDP_FIELD_* values stored (might contain more than
+ *      requested fields), or negative number (error no.) on error.
+ */
+int sdp_query(sdp_t *sdp, unsigned int fields, sdp_va_data_t *va_data,
+                sdp_va_t *va_setpoints, sdp_lcd_info_t *lcd_info)
+{
+        sdp_op_t ops[SDP_QUERY_OPS_MAX];
+        int count, idx, ret, valid = 0;
+
+        if (((fields & SDP_FIELD_VA_DATA) && !va_data) ||
+                        ((fields & SDP_FIELD_SETPOINT) && !va_setpoints) ||
+                        ((fields & SDP_FIELD_LCD_INFO) && !lcd_info)) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        if ( (count = sdp_query_ops(sdp, fields, ops)) < 0)
+                return count;
+
+        for (idx = 0; idx < count; idx++) {
+                ret = sdp_query_op(sdp, ops[idx], va_data, va_setpoints,
+                                lcd_info);
+                if (ret < 0)
+                        return ret;
+                valid |= ret;
+        }
+
+        return valid;
+}
+
+/**
+ * Read snapshot of device state by the cheapest set of reads, see
+ *      sdp_query. Each part of snapshot is timestamped by time its read was
+ *      issued and its response recieved.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param fields        Mask of requested SDP_FIELD_* values, SDP_FIELD_ALL
+ *      to read everything.
+ * @param snap  Pointer to sdp_snapshot_t used to store snapshot, on error
+ *      snap->valid contains fields read before error.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_snapshot(sdp_t *sdp, unsigned int fields, sdp_snapshot_t *snap)
+{
+        sdp_op_t ops[SDP_QUERY_OPS_MAX];
+        sdp_snapshot_time_t time;
+        int count, idx, ret;
+
+        snap->valid = 0;
+        if ( (count = sdp_query_ops(sdp, fields, ops)) < 0)
+                return count;
+
+        for (idx = 0; idx < count; idx++) {
+                time.sent = sdp_time_us();
+                ret = sdp_query_op(sdp, ops[idx], &snap->va_data,
+                                &snap->va_setpoints, &snap->lcd_info);
+                time.recv = sdp_time_us();
+                if (ret < 0)
+                        return ret;
+
+                if (ret & SDP_FIELD_VA_DATA)
+                        snap->va_data_time = time;
+                if (ret & SDP_FIELD_SETPOINT)
+                        snap->va_setpoints_time = time;
+                if (ret & SDP_FIELD_LCD_INFO)
+                        snap->lcd_info_time = time;
+                snap->valid |= ret;
+        }
+
         return 0;
 }
 
@@ -557,7 +1964,7 @@ int sdp_get_lcd_info(const sdp_t *sdp, sdp_lcd_info_t *lcd_info)
  * @param enable        when 0 disable remote operation, otherwise enable.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_remote(const sdp_t *sdp, int enable)
+int sdp_remote(sdp_t *sdp, int enable)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -565,10 +1972,7 @@ int sdp_remote(const sdp_t *sdp, int enable)
         if ( (ret = sdp_sremote(buf, sdp->addr, enable)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -580,7 +1984,7 @@ int sdp_remote(const sdp_t *sdp, int enable)
  * @param preset        number of preset to load.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_run_preset(const sdp_t *sdp, int preset)
+int sdp_run_preset(sdp_t *sdp, int preset)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -588,10 +1992,7 @@ int sdp_run_preset(const sdp_t *sdp, int preset)
         if ( (ret = sdp_srun_preset(buf, sdp->addr, preset)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -604,7 +2005,7 @@ int sdp_run_preset(const sdp_t *sdp, int preset)
  *      repeat forever.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_run_program(const sdp_t *sdp, int count)
+int sdp_run_program(sdp_t *sdp, int count)
 {
         int ret;
         char buf[SDP_BUF_SIZE_MIN];
@@ -612,10 +2013,7 @@ int sdp_run_program(const sdp_t *sdp, int count)
         if ( (ret = sdp_srun_program(buf, sdp->addr, count)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -627,7 +2025,7 @@ int sdp_run_program(const sdp_t *sdp, int count)
  * @param ifce  One of sdp_ifce_rs232 or sdp_ifce_rs485.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_select_ifce(const sdp_t *sdp, sdp_ifce_t ifce)
+int sdp_select_ifce(sdp_t *sdp, sdp_ifce_t ifce)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -635,10 +2033,7 @@ int sdp_select_ifce(const sdp_t *sdp, sdp_ifce_t ifce)
         if ( (ret = sdp_sselect_ifce(buf, sdp->addr, ifce)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -650,7 +2045,7 @@ int sdp_select_ifce(const sdp_t *sdp, sdp_ifce_t ifce)
  * @param curr  Wanted output current of PS: [A].
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_curr(const sdp_t *sdp, double curr)
+int sdp_set_curr(sdp_t *sdp, double curr)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -658,10 +2053,7 @@ int sdp_set_curr(const sdp_t *sdp, double curr)
         if ( (ret = sdp_sset_curr(buf, sdp->addr, curr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -673,7 +2065,7 @@ int sdp_set_curr(const sdp_t *sdp, double curr)
  * @param volt  Wanted output voltage of PS: [V].
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_volt(const sdp_t *sdp, double volt)
+int sdp_set_volt(sdp_t *sdp, double volt)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -681,10 +2073,7 @@ int sdp_set_volt(const sdp_t *sdp, double volt)
         if ( (ret = sdp_sset_volt(buf, sdp->addr, volt)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -696,7 +2085,7 @@ int sdp_set_volt(const sdp_t *sdp, double volt)
  * @param volt  Wanted upper voltage limit: [V].
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_volt_limit(const sdp_t *sdp, double volt)
+int sdp_set_volt_limit(sdp_t *sdp, double volt)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -704,10 +2093,7 @@ int sdp_set_volt_limit(const sdp_t *sdp, double volt)
         if ( (ret = sdp_sset_volt_limit(buf, sdp->addr, volt)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -719,7 +2105,7 @@ int sdp_set_volt_limit(const sdp_t *sdp, double volt)
  * @param enable        When 0 turn output off, otherwise turn on.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_output(const sdp_t *sdp, int enable)
+int sdp_set_output(sdp_t *sdp, int enable)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -727,10 +2113,7 @@ int sdp_set_output(const sdp_t *sdp, int enable)
         if ( (ret = sdp_sset_output(buf, sdp->addr, enable)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -743,7 +2126,7 @@ int sdp_set_output(const sdp_t *sdp, int enable)
  * @param enable        When 0 output is disablen on power, otherwise enabled.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_poweron_output(const sdp_t *sdp, int presn, int enable)
+int sdp_set_poweron_output(sdp_t *sdp, int presn, int enable)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -751,10 +2134,7 @@ int sdp_set_poweron_output(const sdp_t *sdp, int presn, int enable)
         if ( (ret = sdp_sset_poweron_output(buf, sdp->addr, presn, enable)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -767,7 +2147,7 @@ int sdp_set_poweron_output(const sdp_t *sdp, int presn, int enable)
  * @param va_preset     new value of preset.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_preset(const sdp_t *sdp, int presn, const sdp_va_t *va_preset)
+int sdp_set_preset(sdp_t *sdp, int presn, const sdp_va_t *va_preset)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -775,10 +2155,7 @@ int sdp_set_preset(const sdp_t *sdp, int presn, const sdp_va_t *va_preset)
         if ( (ret = sdp_sset_preset(buf, sdp->addr, presn, va_preset)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -791,7 +2168,7 @@ int sdp_set_preset(const sdp_t *sdp, int presn, const sdp_va_t *va_preset)
  * @param program       New value of program item.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_set_program(const sdp_t *sdp, int progn, const sdp_program_t *program)
+int sdp_set_program(sdp_t *sdp, int progn, const sdp_program_t *program)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -799,10 +2176,7 @@ int sdp_set_program(const sdp_t *sdp, int progn, const sdp_program_t *program)
         if ( (ret = sdp_sset_program(buf, sdp->addr, progn, program)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
-                return ret;
-
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
         return 0;
@@ -813,7 +2187,7 @@ int sdp_set_program(const sdp_t *sdp, int progn, const sdp_program_t *program)
  * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
  * @return      On success 0, on error negative number (error no.).
  */
-int sdp_stop(const sdp_t *sdp)
+int sdp_stop(sdp_t *sdp)
 {
         char buf[SDP_BUF_SIZE_MIN];
         int ret;
@@ -821,12 +2195,171 @@ int sdp_stop(const sdp_t *sdp)
         if ( (ret = sdp_sstop(buf, sdp->addr)) < 0)
                 return ret;
 
-        if ( (ret = sdp_write(sdp->f_out, buf, ret)) < 0)
+        if ( (ret = sdp_xfer(sdp, buf, ret, SDP_RESP_LEN_OK)) < 0)
                 return ret;
 
-        if ( (ret = sdp_read_resp(sdp->f_in, buf, SDP_RESP_LEN_OK)) < 0)
+        return 0;
+}
+
+
+/**
+ * Initialize empty batch.
+ * @param batch Pointer to uninitialized sdp_batch_t structure.
+ */
+void sdp_batch_init(sdp_batch_t *batch)
+{
+        batch->cmd_len = 0;
+        batch->count = 0;
+        batch->err = 0;
+}
+
+/**
+ * Get buffer for next command of batch, pass it to one of sdp_s* functions
+ *      and its return value to sdp_batch_add.
+ * @param batch Pointer to sdp_batch_t structure, initialized by
+ *      sdp_batch_init.
+ * @return      Pointer to buffer of size at least SDP_BUF_SIZE_MIN.
+ */
+char *sdp_batch_cmd(sdp_batch_t *batch)
+{
+        return batch->cmd + batch->cmd_len;
+}
+
+/**
+ * Add command prepared in buffer returned by sdp_batch_cmd to batch. When
+ *      command could not be added, error is remembered and sdp_batch_run
+ *      fails without sending anything.
+ * @param batch Pointer to sdp_batch_t structure, initialized by
+ *      sdp_batch_init.
+ * @param len   Return value of sdp_s* function used to prepare command.
+ * @return      Index of command in batch, negative number (error no.)
+ *      on error.
+ */
+int sdp_batch_add(sdp_batch_t *batch, int len)
+{
+        if (len >= 0 && batch->count == SDP_BATCH_MAX) {
+                errno = ERANGE;
+                len = SDP_ETOLARGE;
+        }
+        if (len < 0) {
+                if (!batch->err)
+                        batch->err = len;
+                return len;
+        }
+
+        batch->cmd_len += len;
+
+        return batch->count++;
+}
+
+/**
+ * Send all commands of batch to device by one write and recieve their
+ *      responses. When response for one command is not recieved, all
+ *      following commands are marked failed with the same error, because
+ *      responses can not be assigned to commands anymore.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param batch Pointer to sdp_batch_t structure with commands.
+ * @return      On success 0, on error negative number (error no.) of first
+ *      failed command.
+ */
+int sdp_batch_run(sdp_t *sdp, sdp_batch_t *batch)
+{
+        int idx, off = 0, ret = 0;
+        const char *cmd;
+        long timeout;
+
+        if (batch->err)
+                return batch->err;
+        if (!batch->count)
+                return 0;
+        /* batch can not be splited into thread-safe requests or requests
+         * passed to msdpd */
+        if (sdp->mt || sdp->msdpd) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+
+        /* nothing is send when anny setpoint is out of range of model */
+        cmd = batch->cmd;
+        for (idx = 0; idx < batch->count; idx++) {
+                int cmd_len;
+
+                cmd_len = strchr(cmd, '\r') - cmd + 1;
+                if ( (ret = sdp_caps_check_cmd(sdp->caps, cmd, cmd_len)) < 0)
+                        break;
+                cmd += cmd_len;
+        }
+        if (ret < 0 || (ret = sdp_write(sdp, batch->cmd, batch->cmd_len)) < 0) {
+                for (idx = 0; idx < batch->count; idx++)
+                        batch->ret[idx] = ret;
                 return ret;
+        }
 
-        return 0;
+        /* first response can not arrive before all commands are send */
+        timeout = (batch->cmd_len * 10l * 1000000l) / 9600l;
+        cmd = batch->cmd;
+        for (idx = 0; idx < batch->count; idx++) {
+                int cmd_len, exact, size;
+                sdp_op_t op;
+
+                cmd_len = strchr(cmd, '\r') - cmd + 1;
+                op = sdp_op_id(cmd, cmd_len);
+                size = sizeof(batch->resp) - off;
+                exact = 0;
+                if (sdp_op_resp_len(op) && sdp_op_resp_len(op) <= size) {
+                        size = sdp_op_resp_len(op);
+                        exact = 1;
+                }
+                timeout += sdp_resp_timeout(sdp, op, size);
+                if (sdp_cmd_class(cmd, cmd_len) <= sdp_class_control)
+                        sdp_changed(sdp);
+
+                batch->resp_off[idx] = off;
+                ret = sdp_read_resp(sdp, batch->resp + off, size, exact,
+                                timeout);
+                timeout = 0;
+                batch->ret[idx] = ret;
+                sdp_shadow_update(sdp, cmd, cmd_len, ret);
+                sdp_cache_update(sdp, cmd, cmd_len, batch->resp + off, ret);
+                cmd += cmd_len;
+                if (ret < 0)
+                        break;
+                off += ret;
+        }
+
+        if (ret >= 0)
+                return 0;
+
+        /* commands were send, but it is not known whatever device got them */
+        while (++idx < batch->count) {
+                int cmd_len;
+
+                cmd_len = strchr(cmd, '\r') - cmd + 1;
+                sdp_shadow_update(sdp, cmd, cmd_len, ret);
+                sdp_cache_update(sdp, cmd, cmd_len, NULL, ret);
+                cmd += cmd_len;
+                batch->ret[idx] = ret;
+        }
+
+        return ret;
 }
 
+/**
+ * Get response recieved for command of batch, use corresponding sdp_resp_*
+ *      function to parse it.
+ * @param batch Pointer to sdp_batch_t structure, processed by sdp_batch_run.
+ * @param idx   Index of command returned by sdp_batch_add.
+ * @param buf   Pointer used to store address of response.
+ * @return      Lenght of response, negative number (error no.) on error.
+ */
+int sdp_batch_resp(sdp_batch_t *batch, int idx, char **buf)
+{
+        if (idx < 0 || idx >= batch->count) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        *buf = batch->resp + batch->resp_off[idx];
+
+        return batch->ret[idx];
+}
@@ -0,0 +1,118 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_adapt.h"
+
+#include <math.h>
+
+/**
+ * Get number of commands changing state of device send through sdp.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @return      Value of sdp->changes.
+ */
+static unsigned long sdp_adapt_changes(sdp_t *sdp)
+{
+#ifdef __linux__
+        /* in thread-safe mode counter is updated by owner thread */
+        return __atomic_load_n(&sdp->changes, __ATOMIC_RELAXED);
+#else
+        return sdp->changes;
+#endif
+}
+
+/**
+ * Initialize adaptive poller, first poll is due immediately.
+ * @param adapt Pointer to uninitialized sdp_adapt_t structure.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param min   Polling period used after change [us].
+ * @param max   Longest polling period of stable device [us].
+ * @param dvolt Deadband of voltage [V].
+ * @param dcurr Deadband of current [A].
+ */
+void sdp_adapt_init(sdp_adapt_t *adapt, sdp_t *sdp, long min, long max,
+                double dvolt, double dcurr)
+{
+        adapt->sdp = sdp;
+        adapt->min = min;
+        adapt->max = (max < min) ? min : max;
+        adapt->dvolt = dvolt;
+        adapt->dcurr = dcurr;
+        adapt->period = min;
+        adapt->due = sdp_time_us();
+        adapt->changes = sdp_adapt_changes(sdp);
+        adapt->valid = 0;
+        adapt->polls = 0;
+        adapt->snaps = 0;
+}
+
+/**
+ * Read measured values by sdp_get_va_data when poll is due. This function
+ *      does not sleep, caller waits returned time before next call.
+ * @param adapt Pointer to sdp_adapt_t structure, initialized by
+ *      sdp_adapt_init.
+ * @param va_data       Pointer to sdp_va_data_t used to store reading, not
+ *      changed when poll is not due.
+ * @param wait  Used to store time until next poll is due [us].
+ * @return      1 when device was polled, 0 when poll is not due, negative
+ *      number (error no.) on error.
+ */
+int sdp_adapt_poll(sdp_adapt_t *adapt, sdp_va_data_t *va_data, long *wait)
+{
+        unsigned long changes;
+        long long now;
+        int ret;
+
+        now = sdp_time_us();
+        changes = sdp_adapt_changes(adapt->sdp);
+        /* command send by application is expected to cause transient */
+        if (adapt->changes != changes) {
+                adapt->changes = changes;
+                if (adapt->period != adapt->min)
+                        adapt->snaps++;
+                adapt->period = adapt->min;
+                if (adapt->due > now + adapt->period)
+                        adapt->due = now + adapt->period;
+        }
+        if (adapt->due > now) {
+                *wait = adapt->due - now;
+                return 0;
+        }
+
+        ret = sdp_get_va_data(adapt->sdp, va_data);
+        adapt->polls++;
+        if (ret < 0) {
+                adapt->period = adapt->min;
+        } else if (!adapt->valid || va_data->mode != adapt->ref.mode ||
+                        fabs(va_data->volt - adapt->ref.volt) > adapt->dvolt ||
+                        fabs(va_data->curr - adapt->ref.curr) > adapt->dcurr) {
+                if (adapt->valid && adapt->period != adapt->min)
+                        adapt->snaps++;
+                adapt->ref = *va_data;
+                adapt->valid = 1;
+                adapt->period = adapt->min;
+        } else {
+                adapt->period *= 2;
+                if (adapt->period > adapt->max)
+                        adapt->period = adapt->max;
+        }
+
+        adapt->due = sdp_time_us() + adapt->period;
+        *wait = adapt->period;
+
+        return (ret < 0) ? ret : 1;
+}
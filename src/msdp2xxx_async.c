@@ -0,0 +1,777 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_async.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+        sdp_async_nodata,
+        sdp_async_dev_addr,
+        sdp_async_va_maximums,
+        sdp_async_volt_limit,
+        sdp_async_va_data,
+        sdp_async_va_setpoint,
+        sdp_async_preset,
+        sdp_async_program,
+        sdp_async_lcd_info,
+} sdp_async_kind_t;
+
+/**
+ * Submited operation, owned by library until returned from completion queue.
+ */
+struct sdp_async_req {
+        /** request processed by event loop */
+        sdp_req_t req;
+        /** interface request belongs to */
+        sdp_async_t *async;
+        /** ticket identifying operation */
+        int ticket;
+        /** type of operation, select response parser */
+        sdp_async_kind_t kind;
+        /** where parsed response should be stored */
+        void *out;
+        /** result of operation */
+        int ret;
+        /** errno value when operation failed */
+        int err;
+        /** next item in completion queue */
+        sdp_async_req_t *next;
+};
+
+/**
+ * Parse response of completed request into caller supplied storage.
+ * @param areq  Completed request.
+ * @param buf   Recieved response.
+ * @param len   Lenght of response.
+ * @return      0 on success, negative number (err no.) on error.
+ */
+static int sdp_async_parse(sdp_async_req_t *areq, char *buf, int len)
+{
+        sdp_lcd_info_raw_t lcd_info_raw;
+        int ret;
+
+        switch (areq->kind) {
+                case sdp_async_nodata:
+                        if (sdp_resp(buf, len) != sdp_resp_nodata) {
+                                errno = EINVAL;
+                                return SDP_EINRES;
+                        }
+                        return 0;
+                case sdp_async_dev_addr:
+                        return sdp_resp_dev_addr(buf, len, areq->out);
+                case sdp_async_va_maximums:
+                        return sdp_resp_va_maximums(buf, len, areq->out);
+                case sdp_async_volt_limit:
+                        return sdp_resp_volt_limit(buf, len, areq->out);
+                case sdp_async_va_data:
+                        return sdp_resp_va_data(buf, len, areq->out);
+                case sdp_async_va_setpoint:
+                        return sdp_resp_va_setpoint(buf, len, areq->out);
+                case sdp_async_preset:
+                        return sdp_resp_preset(buf, len, areq->out);
+                case sdp_async_program:
+                        return sdp_resp_program(buf, len, areq->out);
+                case sdp_async_lcd_info:
+                        ret = sdp_resp_lcd_info(buf, len, &lcd_info_raw);
+                        if (ret >= 0)
+                                sdp_lcd_to_data(areq->out, &lcd_info_raw);
+                        return ret;
+        }
+
+        errno = EINVAL;
+        return SDP_EINRES;
+}
+
+/**
+ * Completion callback of event loop, parse response and move operation into
+ *      completion queue.
+ * @param req   Completed request.
+ */
+static void sdp_async_done(sdp_req_t *req)
+{
+        sdp_async_req_t *areq = req->priv;
+        sdp_async_t *async = areq->async;
+
+        if (req->ret < 0) {
+                areq->ret = req->ret;
+                areq->err = req->err;
+        } else {
+                areq->ret = sdp_async_parse(areq, req->resp, req->ret);
+                areq->err = (areq->ret < 0) ? errno : 0;
+        }
+
+        areq->next = NULL;
+        if (async->cq_tail)
+                async->cq_tail->next = areq;
+        else
+                async->cq_head = areq;
+        async->cq_tail = areq;
+}
+
+/**
+ * Allocate new operation.
+ * @param async Pointer to sdp_async_t structure.
+ * @param kind  Type of operation.
+ * @param out   Where parsed response should be stored.
+ * @return      New operation or NULL when out of memory.
+ */
+static sdp_async_req_t *sdp_async_alloc(sdp_async_t *async,
+                sdp_async_kind_t kind, void *out)
+{
+        sdp_async_req_t *areq;
+
+        areq = calloc(1, sizeof(*areq));
+        if (!areq)
+                return NULL;
+
+        areq->async = async;
+        areq->kind = kind;
+        areq->out = out;
+        areq->req.cb = sdp_async_done;
+        areq->req.priv = areq;
+
+        return areq;
+}
+
+/**
+ * Submit prepared operation to event loop.
+ * @param async Pointer to sdp_async_t structure.
+ * @param sdp   Device to send command to.
+ * @param areq  Operation allocated by sdp_async_alloc.
+ * @param len   Lenght of command or negative number (error no.) when
+ *      command could not be prepared.
+ * @return      Ticket of operation or negative number (error no.) on error.
+ */
+static int sdp_async_submit(sdp_async_t *async, sdp_t *sdp,
+                sdp_async_req_t *areq, int len)
+{
+        int ret;
+
+        if (len < 0) {
+                ret = len;
+                goto err;
+        }
+        areq->req.cmd_len = len;
+
+        if (async->ticket == INT_MAX)
+                async->ticket = 0;
+        areq->ticket = ++async->ticket;
+
+        if ( (ret = sdp_loop_submit(&async->loop, sdp, &areq->req)) < 0)
+                goto err;
+
+        return areq->ticket;
+
+err:
+        {
+                int e = errno;
+
+                free(areq);
+                errno = e;
+        }
+        return ret;
+}
+
+/**
+ * Remove operation from completion queue and release it.
+ * @param async Pointer to sdp_async_t structure.
+ * @param prev  Item preceding removed one in queue, or NULL when removed item
+ *      is at head of queue.
+ * @param comp  Used to store result of operation, might be NULL.
+ */
+static void sdp_async_reap(sdp_async_t *async, sdp_async_req_t *prev,
+                sdp_completion_t *comp)
+{
+        sdp_async_req_t *areq;
+
+        areq = prev ? prev->next : async->cq_head;
+        if (prev)
+                prev->next = areq->next;
+        else
+                async->cq_head = areq->next;
+        if (async->cq_tail == areq)
+                async->cq_tail = prev;
+
+        if (comp) {
+                comp->ticket = areq->ticket;
+                comp->ret = areq->ret;
+                comp->err = areq->err;
+        }
+        free(areq);
+}
+
+/**
+ * Initialize asynchronous interface.
+ * @param async Pointer to uninitialized sdp_async_t structure.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_async_init(sdp_async_t *async)
+{
+        memset(async, 0, sizeof(*async));
+
+        return sdp_loop_init(&async->loop);
+}
+
+/**
+ * Release asynchronous interface, operations in progress are canceled and
+ *      all not collected results are dropped.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ */
+void sdp_async_close(sdp_async_t *async)
+{
+        sdp_loop_close(&async->loop);
+        while (async->cq_head)
+                sdp_async_reap(async, NULL, NULL);
+}
+
+/**
+ * Register device, see sdp_loop_add.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_async_add(sdp_async_t *async, sdp_t *sdp)
+{
+        return sdp_loop_add(&async->loop, sdp);
+}
+
+/**
+ * Unregister device, operations in progress are completed with error
+ *      ECANCELED.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_async_del(sdp_async_t *async, sdp_t *sdp)
+{
+        return sdp_loop_del(&async->loop, sdp);
+}
+
+/**
+ * Process pending I/O without blocking and collect results of completed
+ *      operations.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param comp  Array used to store results.
+ * @param max   Size of comp array.
+ * @return      Number of results stored in comp, or negative number
+ *      (error no.) on error.
+ */
+int sdp_poll_completions(sdp_async_t *async, sdp_completion_t *comp, int max)
+{
+        int count = 0, ret;
+
+        if (async->loop.pending) {
+                if ( (ret = sdp_loop_run(&async->loop, 0)) < 0)
+                        return ret;
+        }
+
+        while (count < max && async->cq_head)
+                sdp_async_reap(async, NULL, comp + count++);
+
+        return count;
+}
+
+/**
+ * Wait for completion of operation.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param ticket Ticket of operation to wait for, or 0 to wait for any
+ *      operation.
+ * @param comp  Used to store result of operation, might be NULL.
+ * @param timeout Maximal time to wait [ms], -1 to wait forever.
+ * @return      Result of operation (0 or negative error no.), or
+ *      SDP_ETIMEDOUT when timeout expired, or SDP_EERRNO with errno set to
+ *      ENOENT when there is no such operation.
+ */
+int sdp_wait(sdp_async_t *async, int ticket, sdp_completion_t *comp,
+                int timeout)
+{
+        sdp_completion_t comp_;
+        long long deadline = -1;
+        int ret;
+
+        if (!comp)
+                comp = &comp_;
+        if (timeout >= 0)
+                deadline = sdp_time_us() + timeout * 1000ll;
+
+        for (;;) {
+                sdp_async_req_t *prev = NULL, *areq;
+
+                for (areq = async->cq_head; areq; areq = areq->next) {
+                        if (!ticket || areq->ticket == ticket) {
+                                sdp_async_reap(async, prev, comp);
+                                if (comp->ret == SDP_EERRNO)
+                                        errno = comp->err;
+                                return comp->ret;
+                        }
+                        prev = areq;
+                }
+
+                if (!async->loop.pending) {
+                        errno = ENOENT;
+                        return SDP_EERRNO;
+                }
+                if (deadline >= 0) {
+                        long long now = sdp_time_us();
+
+                        if (now >= deadline) {
+                                errno = ETIMEDOUT;
+                                return SDP_ETIMEDOUT;
+                        }
+                        timeout = (deadline - now + 999) / 1000;
+                }
+
+                if ( (ret = sdp_loop_run(&async->loop, timeout)) < 0)
+                        return ret;
+        }
+}
+
+/**
+ * Submit request to get device address, see sdp_get_dev_addr.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param addr  Pointer to integer used to store device address.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_dev_addr(sdp_async_t *async, sdp_t *sdp, int *addr)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_dev_addr, addr)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_dev_addr(areq->req.cmd, sdp->addr));
+}
+
+/**
+ * Submit request to get maximal voltage and current, see
+ *      sdp_get_va_maximums.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param va_maximums Pointer to sdp_va_t, used to store recieved values.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_va_maximums(sdp_async_t *async, sdp_t *sdp,
+                sdp_va_t *va_maximums)
+{
+        sdp_async_req_t *areq;
+
+        areq = sdp_async_alloc(async, sdp_async_va_maximums, va_maximums);
+        if (!areq)
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_va_maximums(areq->req.cmd, sdp->addr));
+}
+
+/**
+ * Submit request to get upper voltage limit, see sdp_get_volt_limit.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param volt  Pointer to double, used to store retrieved value.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_volt_limit(sdp_async_t *async, sdp_t *sdp, double *volt)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_volt_limit, volt)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_volt_limit(areq->req.cmd, sdp->addr));
+}
+
+/**
+ * Submit request to get actual voltage, current and mode, see
+ *      sdp_get_va_data.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param va_data Pointer to sdp_va_data_t, used to store returned values.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_va_data(sdp_async_t *async, sdp_t *sdp,
+                sdp_va_data_t *va_data)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_va_data, va_data)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_va_data(areq->req.cmd, sdp->addr));
+}
+
+/**
+ * Submit request to get actual setpoint, see sdp_get_va_setpoint.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param va_setpoints Pointer to sdp_va_t, used to store retrieved values.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_va_setpoint(sdp_async_t *async, sdp_t *sdp,
+                sdp_va_t *va_setpoints)
+{
+        sdp_async_req_t *areq;
+
+        areq = sdp_async_alloc(async, sdp_async_va_setpoint, va_setpoints);
+        if (!areq)
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_va_setpoint(areq->req.cmd, sdp->addr));
+}
+
+/**
+ * Submit request to get one or all presets, see sdp_get_preset.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param presn Number of preset 1 - 9 or SDP_PRESET_ALL.
+ * @param va_preset Pointer to sdp_va_t or array of 9 sdp_va_t.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_preset(sdp_async_t *async, sdp_t *sdp,
+                int presn, sdp_va_t *va_preset)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_preset, va_preset)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_preset(areq->req.cmd, sdp->addr, presn));
+}
+
+/**
+ * Submit request to get one or all program items, see sdp_get_program.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param progn Program item number 0 - 19 or SDP_PROGRAM_ALL.
+ * @param program Pointer to sdp_program_t or array of 20 sdp_program_t.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_program(sdp_async_t *async, sdp_t *sdp,
+                int progn, sdp_program_t *program)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_program, program)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_program(areq->req.cmd, sdp->addr, progn));
+}
+
+/**
+ * Submit request to get LCD info, see sdp_get_lcd_info.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param lcd_info Pointer to sdp_lcd_info_t, used to store informations.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_get_lcd_info(sdp_async_t *async, sdp_t *sdp,
+                sdp_lcd_info_t *lcd_info)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_lcd_info, lcd_info)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sget_lcd_info(areq->req.cmd, sdp->addr));
+}
+
+/**
+ * Submit request to enable/disable remote mode, see sdp_remote.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param enable When 0 disable remote operation, otherwise enable.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_remote(sdp_async_t *async, sdp_t *sdp, int enable)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sremote(areq->req.cmd, sdp->addr, enable));
+}
+
+/**
+ * Submit request to load preset, see sdp_run_preset.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param preset Number of preset to load.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_run_preset(sdp_async_t *async, sdp_t *sdp, int preset)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_srun_preset(areq->req.cmd, sdp->addr, preset));
+}
+
+/**
+ * Submit request to run timed program, see sdp_run_program.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param count Count of program repeats or SDP_RUN_PROG_INF.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_run_program(sdp_async_t *async, sdp_t *sdp, int count)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_srun_program(areq->req.cmd, sdp->addr, count));
+}
+
+/**
+ * Submit request to select comunication interface, see
+ *      sdp_select_ifce.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param ifce  One of sdp_ifce_rs232 or sdp_ifce_rs485.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_select_ifce(sdp_async_t *async, sdp_t *sdp, sdp_ifce_t ifce)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sselect_ifce(areq->req.cmd, sdp->addr, ifce));
+}
+
+/**
+ * Submit request to set current setpoint, see sdp_set_curr.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param curr  Wanted output current of PS: [A].
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_curr(sdp_async_t *async, sdp_t *sdp, double curr)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_curr(areq->req.cmd, sdp->addr, curr));
+}
+
+/**
+ * Submit request to set voltage setpoint, see sdp_set_volt.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param volt  Wanted output voltage of PS: [V].
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_volt(sdp_async_t *async, sdp_t *sdp, double volt)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_volt(areq->req.cmd, sdp->addr, volt));
+}
+
+/**
+ * Submit request to set upper voltage limit, see sdp_set_volt_limit.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param volt  Wanted upper voltage limit: [V].
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_volt_limit(sdp_async_t *async, sdp_t *sdp, double volt)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_volt_limit(areq->req.cmd, sdp->addr, volt));
+}
+
+/**
+ * Submit request to turn output on or off, see sdp_set_output.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param enable When 0 turn output off, otherwise turn on.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_output(sdp_async_t *async, sdp_t *sdp, int enable)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_output(areq->req.cmd, sdp->addr, enable));
+}
+
+/**
+ * Submit request to set power on status of output, see
+ *      sdp_set_poweron_output.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param presn Number of preset to set output state.
+ * @param enable When 0 output is disabled on power, otherwise enabled.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_poweron_output(sdp_async_t *async, sdp_t *sdp,
+                int presn, int enable)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_poweron_output(areq->req.cmd, sdp->addr,
+                                presn, enable));
+}
+
+/**
+ * Submit request to set value of preset, see sdp_set_preset.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param presn Number of preset to set.
+ * @param va_preset New value of preset.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_preset(sdp_async_t *async, sdp_t *sdp, int presn,
+                const sdp_va_t *va_preset)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_preset(areq->req.cmd, sdp->addr, presn,
+                                va_preset));
+}
+
+/**
+ * Submit request to set value of program item, see sdp_set_program.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @param progn Number of program item to set.
+ * @param program New value of program item.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_set_program(sdp_async_t *async, sdp_t *sdp, int progn,
+                const sdp_program_t *program)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sset_program(areq->req.cmd, sdp->addr, progn,
+                                program));
+}
+
+/**
+ * Submit request to stop running program, see sdp_stop.
+ * @param async Pointer to sdp_async_t structure, initialized by
+ *      sdp_async_init.
+ * @param sdp   Pointer to device registered by sdp_async_add.
+ * @return      Ticket (positive number) on success, negative number
+ *      (error no.) on error.
+ */
+int sdp_submit_stop(sdp_async_t *async, sdp_t *sdp)
+{
+        sdp_async_req_t *areq;
+
+        if (!(areq = sdp_async_alloc(async, sdp_async_nodata, NULL)))
+                return SDP_EERRNO;
+
+        return sdp_async_submit(async, sdp, areq,
+                        sdp_sstop(areq->req.cmd, sdp->addr));
+}
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_coal.h"
+#include "msdp2xxx_low.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Read exchange, in progress or completed. Completed flight is kept as
+ *      result for freshness window.
+ */
+typedef struct sdp_coal_flight {
+        /** command, identifies device address, command and arguments */
+        char cmd[SDP_BUF_SIZE_MIN];
+        int cmd_len;
+        /** response of device */
+        char resp[SDP_RX_BUF_SIZE];
+        /** lenght of response, or negative number (error no.) on error */
+        int ret;
+        /** value of errno when exchange failed */
+        int err;
+        /** time of completion [us], 0 while exchange is in progress */
+        long long done;
+        /** number of callers waiting for completion */
+        int waiters;
+        /** 1 when flight was replaced by newer one, last waiter frees it */
+        int stale;
+        struct sdp_coal_flight *next;
+} sdp_coal_flight_t;
+
+/**
+ * State of read coalescer of sdp_t.
+ */
+struct sdp_coal {
+        pthread_mutex_t lock;
+        /** broadcasted when any flight completes */
+        pthread_cond_t done;
+        /** age of result which might be reused [us], 0 to reuse only
+         * exchange in progress */
+        long long fresh;
+        /** flights, one for each distinct command */
+        sdp_coal_flight_t *flights;
+        sdp_coal_stats_t stats;
+};
+
+/**
+ * Enable coalescing of identical reads. Read (sdp_get_*) issued while the
+ *      same read of the same device is in progress does not start new
+ *      exchange, it waits and gets its result. Used together with
+ *      sdp_mt_start, when several threads read the same values. Any other
+ *      command drops results kept for freshness window.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param fresh_ms      Result not older than fresh_ms [ms] is returned
+ *      without exchange, 0 to disable.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_coal_start(sdp_t *sdp, int fresh_ms)
+{
+        struct sdp_coal *coal;
+
+        if (sdp->coal) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+        if (fresh_ms < 0) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        coal = calloc(1, sizeof(*coal));
+        if (!coal)
+                return SDP_EERRNO;
+        pthread_mutex_init(&coal->lock, NULL);
+        pthread_cond_init(&coal->done, NULL);
+        coal->fresh = fresh_ms * 1000ll;
+        sdp->coal = coal;
+
+        return 0;
+}
+
+/**
+ * Disable coalescing of reads. No other thread might use sdp during and
+ *      after this call.
+ * @param sdp   Pointer to sdp_t structure.
+ */
+void sdp_coal_stop(sdp_t *sdp)
+{
+        struct sdp_coal *coal = sdp->coal;
+        sdp_coal_flight_t *flight, *next;
+
+        if (!coal)
+                return;
+
+        for (flight = coal->flights; flight; flight = next) {
+                next = flight->next;
+                free(flight);
+        }
+        pthread_cond_destroy(&coal->done);
+        pthread_mutex_destroy(&coal->lock);
+        free(coal);
+        sdp->coal = NULL;
+}
+
+/**
+ * Check whatever command might be coalesced.
+ * @param op    Command identification.
+ * @return      1 for commands which only read device state, 0 otherwise.
+ */
+int sdp_coal_op(sdp_op_t op)
+{
+        return op >= sdp_op_gcom && op <= sdp_op_gpal;
+}
+
+/**
+ * Copy result of flight to caller.
+ * @param flight        Completed flight.
+ * @param buf   Buffer to store response.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+static int sdp_coal_result(sdp_coal_flight_t *flight, char *buf, int size)
+{
+        if (flight->ret < 0) {
+                errno = flight->err;
+                return flight->ret;
+        }
+        if (flight->ret > size) {
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+        memcpy(buf, flight->resp, flight->ret);
+
+        return flight->ret;
+}
+
+/**
+ * Unlink flight from list, it is freed now or by its last waiter.
+ * @param coal  Pointer to sdp_coal structure.
+ * @param flight        Flight to remove.
+ */
+static void sdp_coal_remove(struct sdp_coal *coal, sdp_coal_flight_t *flight)
+{
+        sdp_coal_flight_t **pflight;
+
+        for (pflight = &coal->flights; *pflight; pflight = &(*pflight)->next) {
+                if (*pflight != flight)
+                        continue;
+                *pflight = flight->next;
+                break;
+        }
+        if (flight->waiters)
+                flight->stale = 1;
+        else
+                free(flight);
+}
+
+/**
+ * Exchange read command with device, or attach to the same exchange in
+ *      progress, or reuse fresh result.
+ * @param sdp   Pointer to sdp_t structure with coalescer enabled.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @param xfer  Function used for exchange with device.
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+int sdp_coal_xfer(sdp_t *sdp, char *buf, int len, int size,
+                sdp_xfer_fn_t xfer)
+{
+        struct sdp_coal *coal = sdp->coal;
+        sdp_coal_flight_t *flight;
+        int ret;
+
+        if (len > SDP_BUF_SIZE_MIN)
+                return xfer(sdp, buf, len, size);
+
+        pthread_mutex_lock(&coal->lock);
+        for (flight = coal->flights; flight; flight = flight->next) {
+                if (flight->cmd_len == len && !memcmp(flight->cmd, buf, len))
+                        break;
+        }
+
+        if (flight && !flight->done) {
+                coal->stats.attached++;
+                flight->waiters++;
+                while (!flight->done)
+                        pthread_cond_wait(&coal->done, &coal->lock);
+                flight->waiters--;
+                ret = sdp_coal_result(flight, buf, size);
+                if (flight->stale && !flight->waiters)
+                        free(flight);
+                pthread_mutex_unlock(&coal->lock);
+                return ret;
+        }
+        if (flight && flight->ret >= 0 &&
+                        sdp_time_us() - flight->done <= coal->fresh) {
+                coal->stats.fresh++;
+                ret = sdp_coal_result(flight, buf, size);
+                pthread_mutex_unlock(&coal->lock);
+                return ret;
+        }
+        if (flight)
+                sdp_coal_remove(coal, flight);
+
+        flight = calloc(1, sizeof(*flight));
+        if (!flight) {
+                pthread_mutex_unlock(&coal->lock);
+                return SDP_EERRNO;
+        }
+        memcpy(flight->cmd, buf, len);
+        flight->cmd_len = len;
+        flight->next = coal->flights;
+        coal->flights = flight;
+        coal->stats.exchanges++;
+        pthread_mutex_unlock(&coal->lock);
+
+        memcpy(flight->resp, buf, len);
+        ret = xfer(sdp, flight->resp, len, sizeof(flight->resp));
+
+        pthread_mutex_lock(&coal->lock);
+        flight->ret = ret;
+        flight->err = (ret < 0) ? errno : 0;
+        flight->done = sdp_time_us();
+        pthread_cond_broadcast(&coal->done);
+        ret = sdp_coal_result(flight, buf, size);
+        if (flight->stale && !flight->waiters)
+                free(flight);
+        pthread_mutex_unlock(&coal->lock);
+
+        return ret;
+}
+
+/**
+ * Drop results kept for freshness window, called when device state is
+ *      changed. Exchanges in progress are not affected.
+ * @param sdp   Pointer to sdp_t structure with coalescer enabled.
+ */
+void sdp_coal_invalidate(sdp_t *sdp)
+{
+        struct sdp_coal *coal = sdp->coal;
+        sdp_coal_flight_t *flight, *next;
+
+        if (!coal)
+                return;
+
+        pthread_mutex_lock(&coal->lock);
+        for (flight = coal->flights; flight; flight = next) {
+                next = flight->next;
+                if (flight->done)
+                        sdp_coal_remove(coal, flight);
+        }
+        pthread_mutex_unlock(&coal->lock);
+}
+
+/**
+ * Get statistics of read coalescer.
+ * @param sdp   Pointer to sdp_t structure with coalescer enabled.
+ * @param stats Used to store statistics.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_coal_get_stats(sdp_t *sdp, sdp_coal_stats_t *stats)
+{
+        struct sdp_coal *coal = sdp->coal;
+
+        if (!coal) {
+                errno = ENOENT;
+                return SDP_EERRNO;
+        }
+
+        pthread_mutex_lock(&coal->lock);
+        *stats = coal->stats;
+        pthread_mutex_unlock(&coal->lock);
+
+        return 0;
+}
+
+#endif
@@ -0,0 +1,485 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_disc.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Work of one thread, all devices on one port.
+ */
+struct sdp_disc_job {
+        /** scanned port */
+        const char *port;
+        /** 1 to scan all addresses, 0 to validate devices of port in devs */
+        int scan;
+        /** found devices or devices to validate */
+        sdp_disc_dev_t *devs;
+        int count;
+        int size;
+        /** 1 for each validated device which responded */
+        char *alive;
+        /** number of found or responding devices, negative number
+         * (error no.) on error */
+        int ret;
+        int err;
+};
+
+/**
+ * Open port for probing.
+ * @param sdp   Pointer to uninitialized sdp_t structure.
+ * @param port  Port to open.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_disc_open(sdp_t *sdp, const char *port)
+{
+        sdp_open_opts_t opts;
+
+        memset(&opts, 0, sizeof(opts));
+        opts.flags = SDP_OPEN_LOW_LATENCY | SDP_OPEN_FLUSH;
+
+        return sdp_open_ex(sdp, port, SDP_DEV_ADDR_MIN, &opts);
+}
+
+/**
+ * Probe all addresses on port and read limits of found devices.
+ * @param job   Job with port and buffer for found devices.
+ * @param sdp   Opened port.
+ * @return      Number of found devices, negative number (error no.) on
+ *      error.
+ */
+static int sdp_disc_scan(struct sdp_disc_job *job, sdp_t *sdp)
+{
+        sdp_disc_dev_t *dev;
+        int addr, idx, ret;
+
+        for (addr = SDP_DEV_ADDR_MIN; addr <= SDP_DEV_ADDR_MAX; addr++) {
+                /* missing device or collision on bus */
+                ret = sdp_probe(sdp, addr, 0);
+                if (ret == SDP_EERRNO)
+                        return ret;
+                if (ret < 0)
+                        continue;
+                /* device connected by RS232 responds to anny address, it
+                 * might be recorded already by probe of its own address */
+                if (ret != addr) {
+                        for (idx = 0; idx < job->count; idx++) {
+                                if (job->devs[idx].addr == ret &&
+                                                !strcmp(job->devs[idx].port,
+                                                        job->port))
+                                        break;
+                        }
+                        if (idx < job->count)
+                                break;
+                }
+                if (job->count >= job->size) {
+                        errno = ENOBUFS;
+                        return SDP_EERRNO;
+                }
+
+                dev = &job->devs[job->count++];
+                memset(dev, 0, sizeof(*dev));
+                strcpy(dev->port, job->port);
+                dev->addr = ret;
+                dev->seen = time(NULL);
+                sdp->addr = ret;
+                if ( (ret = sdp_get_va_maximums(sdp, &dev->va_maximums)) < 0)
+                        return ret;
+                if (dev->addr != addr)
+                        break;
+        }
+
+        return job->count;
+}
+
+/**
+ * Probe devices of port registered in job.
+ * @param job   Job with port and devices to validate.
+ * @param sdp   Opened port.
+ * @return      Number of responding devices, negative number (error no.)
+ *      on error.
+ */
+static int sdp_disc_check(struct sdp_disc_job *job, sdp_t *sdp)
+{
+        sdp_disc_dev_t *dev;
+        int idx, ret, alive = 0;
+
+        for (idx = 0; idx < job->count; idx++) {
+                dev = &job->devs[idx];
+                if (strcmp(dev->port, job->port))
+                        continue;
+                ret = sdp_probe(sdp, dev->addr, 0);
+                if (ret == SDP_EERRNO)
+                        return ret;
+                if (ret != dev->addr)
+                        continue;
+                dev->seen = time(NULL);
+                job->alive[idx] = 1;
+                alive++;
+        }
+
+        return alive;
+}
+
+/**
+ * Thread processing one port.
+ * @param arg   Pointer to sdp_disc_job structure.
+ * @return      NULL.
+ */
+static void *sdp_disc_thread(void *arg)
+{
+        struct sdp_disc_job *job = arg;
+        sdp_t sdp;
+
+        job->ret = sdp_disc_open(&sdp, job->port);
+        if (job->ret >= 0) {
+                if (job->scan)
+                        job->ret = sdp_disc_scan(job, &sdp);
+                else
+                        job->ret = sdp_disc_check(job, &sdp);
+                job->err = errno;
+                sdp_close(&sdp);
+        } else {
+                job->err = errno;
+        }
+
+        return NULL;
+}
+
+/**
+ * Run jobs, each in own thread.
+ * @param jobs  Array of jobs.
+ * @param count Number of jobs.
+ * @return      0 on success, negative number (error no.) of first failed
+ *      job.
+ */
+static int sdp_disc_run(struct sdp_disc_job *jobs, int count)
+{
+        pthread_t *threads;
+        int idx, ret = 0;
+
+        threads = calloc(count, sizeof(*threads));
+        if (!threads)
+                return SDP_EERRNO;
+
+        for (idx = 0; idx < count; idx++) {
+                if ( (ret = pthread_create(&threads[idx], NULL,
+                                                sdp_disc_thread, &jobs[idx]))) {
+                        errno = ret;
+                        ret = SDP_EERRNO;
+                        break;
+                }
+        }
+        count = idx;
+        for (idx = 0; idx < count; idx++)
+                pthread_join(threads[idx], NULL);
+        free(threads);
+        if (ret < 0)
+                return ret;
+
+        for (idx = 0; idx < count; idx++) {
+                if (jobs[idx].ret < 0) {
+                        errno = jobs[idx].err;
+                        return jobs[idx].ret;
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * Scan all addresses on all ports, ports are scanned in parallel. Each
+ *      probe is single GCOM with timeout derived from lenght of command and
+ *      response, so scan of port without devices takes about 1 s.
+ * @param ports Names of serial ports.
+ * @param count Number of ports.
+ * @param devs  Array used to store found devices.
+ * @param size  Size of devs.
+ * @return      Number of found devices, negative number (error no.) on
+ *      error.
+ */
+int sdp_discover(const char * const *ports, int count, sdp_disc_dev_t *devs,
+                int size)
+{
+        struct sdp_disc_job *jobs;
+        int idx, found = 0, ret;
+
+        if (count <= 0 || size < 0) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        for (idx = 0; idx < count; idx++) {
+                if (strlen(ports[idx]) >= SDP_DISC_PORT_MAX) {
+                        errno = ENAMETOOLONG;
+                        return SDP_EERRNO;
+                }
+        }
+
+        jobs = calloc(count, sizeof(*jobs));
+        if (!jobs)
+                return SDP_EERRNO;
+        /* each port might have up to all addresses */
+        for (idx = 0; idx < count; idx++) {
+                jobs[idx].port = ports[idx];
+                jobs[idx].scan = 1;
+                jobs[idx].size = SDP_DEV_ADDR_MAX;
+                jobs[idx].devs = calloc(SDP_DEV_ADDR_MAX, sizeof(*devs));
+                if (!jobs[idx].devs) {
+                        ret = SDP_EERRNO;
+                        goto out;
+                }
+        }
+
+        if ( (ret = sdp_disc_run(jobs, count)) < 0)
+                goto out;
+
+        for (idx = 0; idx < count; idx++) {
+                if (found + jobs[idx].count > size) {
+                        errno = ENOBUFS;
+                        ret = SDP_EERRNO;
+                        goto out;
+                }
+                memcpy(devs + found, jobs[idx].devs,
+                                jobs[idx].count * sizeof(*devs));
+                found += jobs[idx].count;
+        }
+        ret = found;
+
+out:
+        for (idx = 0; idx < count; idx++)
+                free(jobs[idx].devs);
+        free(jobs);
+
+        return ret;
+}
+
+/**
+ * Probe registered devices by one GCOM each, devices on different ports are
+ *      probed in parallel. Responding devices get updated last-seen time,
+ *      missing devices are removed from devs.
+ * @param devs  Registered devices.
+ * @param count Number of devices in devs.
+ * @return      Number of responding devices, which are moved to begin of
+ *      devs, negative number (error no.) on error.
+ */
+int sdp_disc_validate(sdp_disc_dev_t *devs, int count)
+{
+        struct sdp_disc_job *jobs;
+        int idx, ports = 0, alive = 0, ret, j;
+        char *alive_map;
+
+        jobs = calloc(count + 1, sizeof(*jobs));
+        alive_map = calloc(count + 1, 1);
+        if (!jobs || !alive_map) {
+                ret = SDP_EERRNO;
+                goto out;
+        }
+
+        /* one job for each distinct port */
+        for (idx = 0; idx < count; idx++) {
+                for (j = 0; j < ports; j++) {
+                        if (!strcmp(jobs[j].port, devs[idx].port))
+                                break;
+                }
+                if (j < ports)
+                        continue;
+                jobs[ports].port = devs[idx].port;
+                jobs[ports].devs = devs;
+                jobs[ports].count = count;
+                jobs[ports].alive = alive_map;
+                ports++;
+        }
+
+        if ( (ret = sdp_disc_run(jobs, ports)) < 0)
+                goto out;
+
+        for (idx = 0; idx < count; idx++) {
+                if (alive_map[idx])
+                        devs[alive++] = devs[idx];
+        }
+        ret = alive;
+
+out:
+        free(alive_map);
+        free(jobs);
+
+        return ret;
+}
+
+/**
+ * Load registry of devices.
+ * @param fname Name of registry file.
+ * @param devs  Array used to store devices.
+ * @param size  Size of devs.
+ * @return      Number of loaded devices, negative number (error no.) on
+ *      error.
+ */
+int sdp_disc_load(const char *fname, sdp_disc_dev_t *devs, int size)
+{
+        char line[256];
+        long long seen;
+        int count = 0;
+        FILE *f;
+
+        f = fopen(fname, "r");
+        if (!f)
+                return SDP_EERRNO;
+
+        while (fgets(line, sizeof(line), f)) {
+                sdp_disc_dev_t *dev = &devs[count];
+
+                if (line[0] == '#' || line[0] == '\n')
+                        continue;
+                if (count >= size) {
+                        fclose(f);
+                        errno = ENOBUFS;
+                        return SDP_EERRNO;
+                }
+                memset(dev, 0, sizeof(*dev));
+                if (sscanf(line, "%63s %d %lf %lf %lld", dev->port, &dev->addr,
+                                        &dev->va_maximums.volt,
+                                        &dev->va_maximums.curr, &seen) != 5 ||
+                                dev->addr < SDP_DEV_ADDR_MIN ||
+                                dev->addr > SDP_DEV_ADDR_MAX) {
+                        fclose(f);
+                        errno = EINVAL;
+                        return SDP_EERRNO;
+                }
+                dev->seen = seen;
+                count++;
+        }
+        fclose(f);
+
+        return count;
+}
+
+/**
+ * Store registry of devices, file is replaced atomically.
+ * @param fname Name of registry file.
+ * @param devs  Devices to store.
+ * @param count Number of devices in devs.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_disc_save(const char *fname, const sdp_disc_dev_t *devs, int count)
+{
+        char tmp[FILENAME_MAX];
+        FILE *f;
+        int idx;
+
+        if (snprintf(tmp, sizeof(tmp), "%s.tmp", fname) >= (int)sizeof(tmp)) {
+                errno = ENAMETOOLONG;
+                return SDP_EERRNO;
+        }
+
+        f = fopen(tmp, "w");
+        if (!f)
+                return SDP_EERRNO;
+
+        fprintf(f, "# port addr volt_max curr_max last_seen\n");
+        for (idx = 0; idx < count; idx++) {
+                fprintf(f, "%s %d %.1f %.2f %lld\n", devs[idx].port,
+                                devs[idx].addr, devs[idx].va_maximums.volt,
+                                devs[idx].va_maximums.curr,
+                                (long long)devs[idx].seen);
+        }
+        if (fclose(f) == EOF || rename(tmp, fname) < 0) {
+                int e = errno;
+
+                unlink(tmp);
+                errno = e;
+                return SDP_EERRNO;
+        }
+
+        return 0;
+}
+
+/**
+ * Get devices from registry, bus is scanned only when registry is missing
+ *      or some of registered devices does not respond. Registry is updated
+ *      in both cases.
+ * @param fname Name of registry file.
+ * @param ports Names of serial ports scanned when registry is not valid.
+ * @param count Number of ports.
+ * @param devs  Array used to store devices.
+ * @param size  Size of devs.
+ * @return      Number of devices, negative number (error no.) on error.
+ */
+int sdp_disc_registry(const char *fname, const char * const *ports,
+                int count, sdp_disc_dev_t *devs, int size)
+{
+        int found, ret;
+
+        found = sdp_disc_load(fname, devs, size);
+        if (found > 0) {
+                /* registry is not valid when port can not be opened */
+                ret = sdp_disc_validate(devs, found);
+                if (ret == found)
+                        goto save;
+        } else if (found < 0 && errno != ENOENT && errno != EINVAL) {
+                return found;
+        }
+
+        if ( (found = sdp_discover(ports, count, devs, size)) < 0)
+                return found;
+save:
+        if ( (ret = sdp_disc_save(fname, devs, found)) < 0)
+                return ret;
+
+        return found;
+}
+
+/**
+ * Set model of device by its record in registry, no exchange with device is
+ *      needed to check setpoints against limits of model.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param port  Port sdp was opened on.
+ * @param devs  Devices from registry.
+ * @param count Number of devices in devs.
+ * @return      Model of device, negative number (error no.) when device is
+ *      not in registry.
+ */
+int sdp_disc_attach(sdp_t *sdp, const char *port, const sdp_disc_dev_t *devs,
+                int count)
+{
+        sdp_model_t model;
+        int idx;
+
+        for (idx = 0; idx < count; idx++) {
+                if (devs[idx].addr == sdp->addr &&
+                                !strcmp(devs[idx].port, port))
+                        break;
+        }
+        if (idx == count) {
+                errno = ENOENT;
+                return SDP_EERRNO;
+        }
+
+        model = sdp_model_identify(&devs[idx].va_maximums);
+        sdp_set_model(sdp, model);
+
+        return model;
+}
+
+#endif
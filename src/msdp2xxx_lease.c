@@ -0,0 +1,301 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_lease.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Get wall clock time, lease must survive restart of process.
+ * @return      Time since epoch [us].
+ */
+static long long sdp_lease_now(void)
+{
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+
+        return tv.tv_sec * 1000000ll + tv.tv_usec;
+}
+
+/**
+ * Open and lock state file of port, file name is derived from port name.
+ *      Directory might be shared with other users, so symbolic link is not
+ *      followed and file must be owned by the user.
+ * @param port  Name of port.
+ * @return      File descriptor, or negative number (error no.) on error,
+ *      EACCES when file is not regular file owned by the user.
+ */
+static int sdp_lease_open(const char *port)
+{
+        char path[PATH_MAX];
+        const char *dir;
+        struct stat st;
+        int fd, len, e;
+        char *c;
+
+        dir = getenv("MSDP_LEASE_DIR");
+        if (!dir || !dir[0])
+                dir = getenv("XDG_RUNTIME_DIR");
+        if (!dir || !dir[0])
+                dir = SDP_LEASE_DIR;
+        len = snprintf(path, sizeof(path), "%s/msdp2xxx", dir);
+        if (len + strlen(port) + sizeof(".lease") > sizeof(path)) {
+                errno = ENAMETOOLONG;
+                return SDP_EERRNO;
+        }
+        strcpy(path + len, port);
+        for (c = path + len; *c; c++) {
+                if (*c == '/')
+                        *c = '_';
+        }
+        strcat(path, ".lease");
+
+        fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0)
+                return SDP_EERRNO;
+        if (fstat(fd, &st) < 0)
+                goto err;
+        if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+                errno = EACCES;
+                goto err;
+        }
+        while (flock(fd, LOCK_EX) < 0) {
+                if (errno != EINTR)
+                        goto err;
+        }
+
+        return fd;
+
+err:
+        e = errno;
+        close(fd);
+        errno = e;
+        return SDP_EERRNO;
+}
+
+/**
+ * Read state file.
+ * @param lease Lease with locked file.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_lease_read(sdp_lease_t *lease)
+{
+        char buf[1024], *line, *end;
+        long long expiry;
+        ssize_t len;
+        int addr;
+        long pid;
+
+        memset(lease->expiry, 0, sizeof(lease->expiry));
+        lease->reaper = 0;
+
+        len = pread(lease->fd, buf, sizeof(buf) - 1, 0);
+        if (len < 0)
+                return SDP_EERRNO;
+        buf[len] = '\0';
+
+        for (line = buf; *line; line = end) {
+                end = strchr(line, '\n');
+                if (end)
+                        *end++ = '\0';
+                else
+                        end = line + strlen(line);
+
+                if (sscanf(line, "reaper %ld", &pid) == 1)
+                        lease->reaper = pid;
+                else if (sscanf(line, "%d %lld", &addr, &expiry) == 2 &&
+                                addr >= SDP_DEV_ADDR_MIN &&
+                                addr <= SDP_DEV_ADDR_MAX)
+                        lease->expiry[addr] = expiry;
+        }
+
+        return 0;
+}
+
+/**
+ * Write state file.
+ * @param lease Lease with locked file.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_lease_write(sdp_lease_t *lease)
+{
+        char buf[1024];
+        int addr, len;
+
+        len = snprintf(buf, sizeof(buf), "reaper %ld\n", (long)lease->reaper);
+        for (addr = SDP_DEV_ADDR_MIN; addr <= SDP_DEV_ADDR_MAX; addr++) {
+                if (lease->expiry[addr])
+                        len += snprintf(buf + len, sizeof(buf) - len,
+                                        "%d %lld\n", addr, lease->expiry[addr]);
+        }
+
+        if (ftruncate(lease->fd, 0) < 0 ||
+                        pwrite(lease->fd, buf, len, 0) != len)
+                return SDP_EERRNO;
+
+        return 0;
+}
+
+/**
+ * Lock lease of port, blocks while other process holds it.
+ * @param lease Pointer to uninitialized sdp_lease_t structure.
+ * @param port  Name of port.
+ * @param addr  Device address.
+ * @return      1 when remote session of device is active and SESS might
+ *      be skipped, 0 when it is not, negative number (error no.) on error.
+ */
+int sdp_lease_lock(sdp_lease_t *lease, const char *port, int addr)
+{
+        int ret;
+
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        lease->addr = addr;
+        if ( (lease->fd = sdp_lease_open(port)) < 0)
+                return lease->fd;
+
+        if ( (ret = sdp_lease_read(lease)) < 0) {
+                int e = errno;
+
+                close(lease->fd);
+                errno = e;
+                return ret;
+        }
+
+        return lease->expiry[addr] > sdp_lease_now();
+}
+
+/**
+ * Record session state and unlock lease.
+ * @param lease Pointer to sdp_lease_t structure locked by sdp_lease_lock.
+ * @param ttl   Time session stays active [us], 0 when session was ended
+ *      by ENDS.
+ * @return      1 when session is active and no process ends lapsed
+ *      sessions, caller should start sdp_lease_reap; 0 when not needed,
+ *      negative number (error no.) on error.
+ */
+int sdp_lease_unlock(sdp_lease_t *lease, long ttl)
+{
+        int ret;
+
+        if (ttl > 0)
+                lease->expiry[lease->addr] = sdp_lease_now() + ttl;
+        else
+                lease->expiry[lease->addr] = 0;
+
+        ret = sdp_lease_write(lease);
+        if (ret >= 0)
+                ret = ttl > 0 && (!lease->reaper ||
+                                kill(lease->reaper, 0) < 0);
+        close(lease->fd);
+
+        return ret;
+}
+
+/**
+ * Send ENDS to devices whose lease lapsed, until no session on port is
+ *      active. This function sleeps, it is intended to run in background
+ *      process started when sdp_lease_unlock returns 1. Only one reaper
+ *      runs for each port.
+ * @param port  Name of port.
+ * @return      0 when all sessions ended, negative number (error no.) on
+ *      error.
+ */
+int sdp_lease_reap(const char *port)
+{
+        long long now, next;
+        struct timespec ts;
+        sdp_lease_t lease;
+        int addr, ret;
+        sdp_t sdp;
+
+        if ( (lease.fd = sdp_lease_open(port)) < 0)
+                return lease.fd;
+        if ( (ret = sdp_lease_read(&lease)) < 0)
+                goto out;
+        if (lease.reaper && lease.reaper != getpid() &&
+                        kill(lease.reaper, 0) == 0) {
+                ret = 0;
+                goto out;
+        }
+        lease.reaper = getpid();
+
+        for (;;) {
+                now = sdp_lease_now();
+                next = 0;
+                for (addr = SDP_DEV_ADDR_MIN; addr <= SDP_DEV_ADDR_MAX;
+                                addr++) {
+                        if (!lease.expiry[addr])
+                                continue;
+                        if (lease.expiry[addr] > now) {
+                                if (!next || lease.expiry[addr] < next)
+                                        next = lease.expiry[addr];
+                                continue;
+                        }
+                        /* port is used only by lease holder, which is us */
+                        if (sdp_open(&sdp, port, addr) >= 0) {
+                                sdp_remote(&sdp, 0);
+                                sdp_close(&sdp);
+                        }
+                        lease.expiry[addr] = 0;
+                }
+                if (!next)
+                        lease.reaper = 0;
+                if ( (ret = sdp_lease_write(&lease)) < 0 || !next)
+                        goto out;
+                close(lease.fd);
+
+                ts.tv_sec = (next - now) / 1000000;
+                ts.tv_nsec = (next - now) % 1000000 * 1000;
+                while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+                        ;
+
+                if ( (lease.fd = sdp_lease_open(port)) < 0)
+                        return lease.fd;
+                if ( (ret = sdp_lease_read(&lease)) < 0)
+                        goto out;
+                /* lease was cleared by ENDS, nothing to reap */
+                if (lease.reaper != getpid()) {
+                        ret = 0;
+                        goto out;
+                }
+        }
+
+out:
+        close(lease.fd);
+
+        return ret;
+}
+
+#endif
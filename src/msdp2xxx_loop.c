@@ -0,0 +1,679 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_loop.h"
+#include "msdp2xxx_low.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+/** Maximal number of events processed by one epoll_wait call. */
+#define SDP_LOOP_EVENTS (64)
+
+typedef enum {
+        /** no request in progress */
+        sdp_loop_idle,
+        /** command is being writen */
+        sdp_loop_write,
+        /** command was writen, waiting for response */
+        sdp_loop_read,
+} sdp_loop_state_t;
+
+/**
+ * Device registered in event loop.
+ */
+struct sdp_loop_port {
+        /** device */
+        sdp_t *sdp;
+        /** state of request in progress */
+        sdp_loop_state_t state;
+        /** request in progress */
+        sdp_req_t *cur;
+        /** queued requests */
+        sdp_sched_t queue;
+        /** command of request in progress */
+        sdp_op_t op;
+        /** lenght of expected response of request in progress */
+        int expect;
+        /** number of command bytes already writen */
+        int written;
+        /** time when writing of command started [us] */
+        long long start;
+        /** time when waiting for response expire [us] */
+        long long deadline;
+        /** 1 when waiting for f_out to become writable */
+        int want_out;
+        /** 1 when port state is just processed, prevents recursion from
+         * completion callbacks */
+        int busy;
+        /** when non zero, port failed with this errno and is unusable */
+        int broken;
+        /** 1 when port was removed from loop, see sdp_loop_reap */
+        int dead;
+        /** next removed port */
+        sdp_loop_port_t *next;
+};
+
+/**
+ * Set file descriptor to non-blocking mode.
+ * @param fd    File descriptor.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_loop_nonblock(int fd)
+{
+        int flags;
+
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0)
+                return SDP_EERRNO;
+        if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+                return SDP_EERRNO;
+
+        return 0;
+}
+
+/**
+ * Find registered device.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param sdp   Device to find.
+ * @return      Index of device in loop->ports or -1 when not registered.
+ */
+static int sdp_loop_find(sdp_loop_t *loop, sdp_t *sdp)
+{
+        int idx;
+
+        for (idx = 0; idx < loop->count; idx++) {
+                if (loop->ports[idx]->sdp == sdp)
+                        return idx;
+        }
+
+        return -1;
+}
+
+/**
+ * Free removed ports. Port removed by completion callback might be still
+ *      referenced by its caller or by events returned by epoll_wait, so it
+ *      is freed only after processing of events ends.
+ * @param loop  Pointer to sdp_loop_t structure.
+ */
+static void sdp_loop_reap(sdp_loop_t *loop)
+{
+        sdp_loop_port_t **it = &loop->dead, *port;
+
+        if (loop->running)
+                return;
+
+        while ( (port = *it)) {
+                if (port->busy) {
+                        it = &port->next;
+                        continue;
+                }
+                *it = port->next;
+                free(port);
+        }
+}
+
+/**
+ * Remove request from head of port queue and report result to caller.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port with request in progress.
+ * @param ret   Result of request, on error errno must be set.
+ */
+static void sdp_loop_complete(sdp_loop_t *loop, sdp_loop_port_t *port,
+                int ret)
+{
+        sdp_req_t *req = port->cur;
+
+        req->err = (ret < 0) ? errno : 0;
+        req->ret = ret;
+        if (port->state == sdp_loop_read) {
+                sdp_rtt_update(port->sdp, port->op, ret,
+                                sdp_time_us() - port->start);
+                sdp_breaker_update(&port->sdp->breaker[sdp_cmd_addr(
+                                        req->cmd, req->cmd_len)], ret);
+        }
+        /* command might be (partially) send */
+        if (port->state != sdp_loop_idle) {
+                sdp_shadow_update(port->sdp, req->cmd, req->cmd_len, ret);
+                sdp_cache_update(port->sdp, req->cmd, req->cmd_len,
+                                req->resp, ret);
+        }
+
+        port->cur = NULL;
+        port->state = sdp_loop_idle;
+        loop->pending--;
+        loop->completed++;
+
+        if (req->cb)
+                req->cb(req);
+}
+
+/**
+ * Enable or disable waiting for f_out to become writable.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port to modify.
+ * @param enable        0 to disable, enable otherwise.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_loop_want_out(sdp_loop_t *loop, sdp_loop_port_t *port,
+                int enable)
+{
+        struct epoll_event ev;
+        sdp_t *sdp = port->sdp;
+        int ret;
+
+        enable = !!enable;
+        if (port->want_out == enable)
+                return 0;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.data.ptr = port;
+        if (sdp->f_in == sdp->f_out) {
+                ev.events = EPOLLIN | (enable ? EPOLLOUT : 0);
+                ret = epoll_ctl(loop->epfd, EPOLL_CTL_MOD, sdp->f_out, &ev);
+        } else {
+                ev.events = EPOLLOUT;
+                ret = epoll_ctl(loop->epfd,
+                                enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+                                sdp->f_out, &ev);
+        }
+        if (ret < 0)
+                return SDP_EERRNO;
+        port->want_out = enable;
+
+        return 0;
+}
+
+/**
+ * Mark port as unusable and fail all queued requests.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port which failed.
+ * @param err   Error (errno value) which caused failure.
+ */
+static void sdp_loop_break(sdp_loop_t *loop, sdp_loop_port_t *port, int err)
+{
+        sdp_t *sdp = port->sdp;
+
+        if (!port->broken) {
+                sdp_loop_want_out(loop, port, 0);
+                epoll_ctl(loop->epfd, EPOLL_CTL_DEL, sdp->f_in, NULL);
+                port->broken = err;
+        }
+        sdp_rx_init(&sdp->rx);
+
+        while (port->cur || (port->cur = sdp_sched_pop(&port->queue))) {
+                errno = err;
+                sdp_loop_complete(loop, port, SDP_EERRNO);
+        }
+}
+
+/**
+ * Check framer for complete response of request in progress.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port waiting for response.
+ */
+static void sdp_loop_frame(sdp_loop_t *loop, sdp_loop_port_t *port)
+{
+        int ret;
+
+        ret = sdp_rx_resp(&port->sdp->rx, port->cur->resp, port->expect,
+                        port->expect != sizeof(port->cur->resp));
+        if (ret)
+                sdp_loop_complete(loop, port, ret);
+}
+
+/**
+ * Write (rest of) command of request in progress.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port with command to write.
+ */
+static void sdp_loop_send(sdp_loop_t *loop, sdp_loop_port_t *port)
+{
+        sdp_req_t *req = port->cur;
+        ssize_t ret;
+
+        ret = write(port->sdp->f_out, req->cmd + port->written,
+                        req->cmd_len - port->written);
+        if (ret < 0) {
+                if (errno != EAGAIN) {
+                        sdp_loop_complete(loop, port, SDP_EERRNO);
+                        return;
+                }
+                ret = 0;
+        }
+
+        port->written += ret;
+        if (port->written < req->cmd_len) {
+                if (sdp_loop_want_out(loop, port, 1) < 0)
+                        sdp_loop_complete(loop, port, SDP_EERRNO);
+                return;
+        }
+
+        if (sdp_loop_want_out(loop, port, 0) < 0) {
+                sdp_loop_complete(loop, port, SDP_EERRNO);
+                return;
+        }
+
+        port->state = sdp_loop_read;
+        port->deadline = port->start +
+                sdp_resp_timeout(port->sdp, port->op, port->expect);
+        sdp_loop_frame(loop, port);
+}
+
+/**
+ * Read data available on f_in.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port with data ready to read.
+ */
+static void sdp_loop_recv(sdp_loop_t *loop, sdp_loop_port_t *port)
+{
+        sdp_t *sdp = port->sdp;
+        ssize_t size;
+        char *buf;
+        int space;
+
+        space = sdp_rx_space(&sdp->rx, &buf);
+        if (!space) {
+                sdp_rx_init(&sdp->rx);
+                space = sdp_rx_space(&sdp->rx, &buf);
+        }
+
+        size = read(sdp->f_in, buf, space);
+        if (size <= 0) {
+                if (size < 0 && errno == EAGAIN)
+                        return;
+                sdp_loop_break(loop, port, size ? errno : EIO);
+                return;
+        }
+        sdp_rx_commit(&sdp->rx, size);
+
+        if (port->state == sdp_loop_read) {
+                sdp_loop_frame(loop, port);
+                if (port->state == sdp_loop_read &&
+                                !sdp_rx_space(&sdp->rx, &buf)) {
+                        sdp_rx_init(&sdp->rx);
+                        errno = ERANGE;
+                        sdp_loop_complete(loop, port, SDP_ETOLARGE);
+                }
+        } else {
+                /* nobody is waiting for this data */
+                sdp_rx_init(&sdp->rx);
+        }
+}
+
+/**
+ * Start processing of queued requests, until port is waiting for I/O.
+ * @param loop  Pointer to sdp_loop_t structure.
+ * @param port  Port to process.
+ */
+static void sdp_loop_kick(sdp_loop_t *loop, sdp_loop_port_t *port)
+{
+        sdp_req_t *req;
+        int ret;
+
+        while (port->state == sdp_loop_idle &&
+                        (port->cur = sdp_sched_pop(&port->queue))) {
+                req = port->cur;
+                ret = sdp_caps_check_cmd(port->sdp->caps, req->cmd,
+                                req->cmd_len);
+                if (ret < 0) {
+                        sdp_loop_complete(loop, port, ret);
+                        continue;
+                }
+                /* device holds setpoint already */
+                if (sdp_shadow_check(port->sdp, req->cmd, req->cmd_len)) {
+                        memcpy(req->resp, "OK\r", SDP_RESP_LEN_OK);
+                        sdp_loop_complete(loop, port, SDP_RESP_LEN_OK);
+                        continue;
+                }
+                ret = sdp_cache_get(port->sdp, req->cmd, req->cmd_len,
+                                req->resp, sizeof(req->resp));
+                if (ret > 0) {
+                        sdp_loop_complete(loop, port, ret);
+                        continue;
+                }
+                if (sdp_cmd_class(req->cmd, req->cmd_len) <= sdp_class_control)
+                        __atomic_fetch_add(&port->sdp->changes, 1,
+                                        __ATOMIC_RELAXED);
+                /* device which does not respond is not waited for, after
+                 * backoff request itself probes device */
+                ret = sdp_breaker_allow(&port->sdp->breaker[sdp_cmd_addr(
+                                        req->cmd, req->cmd_len)]);
+                if (ret < 0) {
+                        sdp_loop_complete(loop, port, ret);
+                        continue;
+                }
+                port->state = sdp_loop_write;
+                port->op = sdp_op_id(port->cur->cmd, port->cur->cmd_len);
+                port->expect = sdp_op_resp_len(port->op);
+                if (!port->expect)
+                        port->expect = sizeof(port->cur->resp);
+                port->written = 0;
+                port->start = sdp_time_us();
+                sdp_loop_send(loop, port);
+        }
+}
+
+/**
+ * Initialize event loop.
+ * @param loop  Pointer to uninitialized sdp_loop_t structure.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_loop_init(sdp_loop_t *loop)
+{
+        memset(loop, 0, sizeof(*loop));
+        loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epfd < 0)
+                return SDP_EERRNO;
+
+        return 0;
+}
+
+/**
+ * Remove all devices from loop and release loop resources. Devices are not
+ *      closed.
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ */
+void sdp_loop_close(sdp_loop_t *loop)
+{
+        while (loop->count)
+                sdp_loop_del(loop, loop->ports[0]->sdp);
+
+        free(loop->ports);
+        loop->ports = NULL;
+        loop->alloc = 0;
+        close(loop->epfd);
+        loop->epfd = -1;
+}
+
+/**
+ * Register device in loop. File descriptors of device are switched to
+ *      non-blocking mode. Device connected by sdp_msdpd_open, attached to
+ *      io_uring or in thread-safe mode can not be registered (EBUSY).
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_loop_add(sdp_loop_t *loop, sdp_t *sdp)
+{
+        struct epoll_event ev;
+        sdp_loop_port_t *port;
+        int ret;
+
+        if (sdp_loop_find(loop, sdp) >= 0) {
+                errno = EEXIST;
+                return SDP_EERRNO;
+        }
+        /* connection to msdpd needs its own framing, port attached to
+         * io_uring or owner thread would be used by two drivers at once */
+        if (sdp->msdpd || sdp->uring || sdp->mt) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+
+        if ( (ret = sdp_loop_nonblock(sdp->f_in)) < 0)
+                return ret;
+        if ( (ret = sdp_loop_nonblock(sdp->f_out)) < 0)
+                return ret;
+
+        if (loop->count == loop->alloc) {
+                sdp_loop_port_t **ports;
+                int alloc;
+
+                alloc = loop->alloc ? loop->alloc * 2 : 8;
+                ports = realloc(loop->ports, alloc * sizeof(*ports));
+                if (!ports)
+                        return SDP_EERRNO;
+                loop->ports = ports;
+                loop->alloc = alloc;
+        }
+
+        port = calloc(1, sizeof(*port));
+        if (!port)
+                return SDP_EERRNO;
+        port->sdp = sdp;
+        port->state = sdp_loop_idle;
+        sdp_sched_init(&port->queue);
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = port;
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, sdp->f_in, &ev) < 0) {
+                int e = errno;
+
+                free(port);
+                errno = e;
+                return SDP_EERRNO;
+        }
+
+        loop->ports[loop->count++] = port;
+
+        return 0;
+}
+
+/**
+ * Remove device from loop, all queued requests of device are completed with
+ *      error ECANCELED. Might be called from completion callback.
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ * @param sdp   Pointer to device registered by sdp_loop_add.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_loop_del(sdp_loop_t *loop, sdp_t *sdp)
+{
+        sdp_loop_port_t *port;
+        int busy, idx;
+
+        idx = sdp_loop_find(loop, sdp);
+        if (idx < 0) {
+                errno = ENOENT;
+                return SDP_EERRNO;
+        }
+        port = loop->ports[idx];
+        /* callbacks called below can not find port anymore */
+        loop->ports[idx] = loop->ports[--loop->count];
+        port->dead = 1;
+        port->next = loop->dead;
+        loop->dead = port;
+
+        busy = port->busy;
+        port->busy = 1;
+        sdp_loop_break(loop, port, ECANCELED);
+        port->busy = busy;
+        sdp_loop_reap(loop);
+
+        return 0;
+}
+
+/**
+ * Submit request to device. Request must stay valid until its completion
+ *      callback is called.
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ * @param sdp   Pointer to device registered by sdp_loop_add.
+ * @param req   Request with command prepared by one of sdp_s* functions.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_loop_submit(sdp_loop_t *loop, sdp_t *sdp, sdp_req_t *req)
+{
+        sdp_loop_port_t *port;
+        sdp_req_t *old;
+        int idx;
+
+        if (req->cmd_len <= 0 || req->cmd_len > (int)sizeof(req->cmd)) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        idx = sdp_loop_find(loop, sdp);
+        if (idx < 0) {
+                errno = ENOENT;
+                return SDP_EERRNO;
+        }
+        port = loop->ports[idx];
+        if (port->broken) {
+                errno = port->broken;
+                return SDP_EERRNO;
+        }
+
+        req->sdp = sdp;
+        req->ret = 0;
+        req->err = 0;
+        old = sdp_sched_push(&port->queue, req, &sdp->shadow);
+        if (old) {
+                /* replaced request is completed, new one takes its place */
+                loop->completed++;
+                if (old->cb)
+                        old->cb(old);
+        } else {
+                loop->pending++;
+        }
+
+        if (!port->busy) {
+                port->busy = 1;
+                sdp_loop_kick(loop, port);
+                port->busy = 0;
+                sdp_loop_reap(loop);
+        }
+
+        return 0;
+}
+
+/**
+ * Get time until nearest response timeout, used when loop->epfd is waited
+ *      for by caller together with other file descriptors. sdp_loop_run
+ *      must be called when it expires.
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ * @return      Time to wait [ms], -1 when no response is expected.
+ */
+int sdp_loop_timeout(sdp_loop_t *loop)
+{
+        long long deadline = -1, now;
+        int idx;
+
+        for (idx = 0; idx < loop->count; idx++) {
+                sdp_loop_port_t *port = loop->ports[idx];
+
+                if (port->state != sdp_loop_read)
+                        continue;
+                if (deadline < 0 || port->deadline < deadline)
+                        deadline = port->deadline;
+        }
+        if (deadline < 0)
+                return -1;
+
+        now = sdp_time_us();
+
+        return (deadline > now) ? (deadline - now + 999) / 1000 : 0;
+}
+
+/**
+ * Wait for events on registered devices and process them.
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ * @param timeout       Maximal time to wait for event [ms], -1 to wait
+ *      until at least one event occurs.
+ * @return      Number of completed requests, or negative number (error no.)
+ *      on error.
+ */
+int sdp_loop_run(sdp_loop_t *loop, int timeout)
+{
+        struct epoll_event ev[SDP_LOOP_EVENTS];
+        unsigned long completed;
+        long long now;
+        int idx, n, wait;
+
+        completed = loop->completed;
+
+        wait = sdp_loop_timeout(loop);
+        if (wait >= 0 && (timeout < 0 || wait < timeout))
+                timeout = wait;
+
+        n = epoll_wait(loop->epfd, ev, SDP_LOOP_EVENTS, timeout);
+        if (n < 0) {
+                if (errno != EINTR)
+                        return SDP_EERRNO;
+                n = 0;
+        }
+
+        /* ports removed by callbacks are freed at end */
+        loop->running++;
+        for (idx = 0; idx < n; idx++) {
+                sdp_loop_port_t *port = ev[idx].data.ptr;
+
+                if (port->dead)
+                        continue;
+                port->busy = 1;
+                if ((ev[idx].events & EPOLLOUT) &&
+                                port->state == sdp_loop_write)
+                        sdp_loop_send(loop, port);
+                if ((ev[idx].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) &&
+                                !port->broken && !port->dead)
+                        sdp_loop_recv(loop, port);
+                if (!port->dead)
+                        sdp_loop_kick(loop, port);
+                port->busy = 0;
+        }
+
+        now = sdp_time_us();
+        for (idx = 0; idx < loop->count; idx++) {
+                sdp_loop_port_t *port = loop->ports[idx];
+
+                if (port->state != sdp_loop_read || port->deadline > now)
+                        continue;
+
+                port->busy = 1;
+                sdp_rx_expire(&port->sdp->rx);
+                errno = ETIMEDOUT;
+                sdp_loop_complete(loop, port, SDP_ETIMEDOUT);
+                if (!port->dead)
+                        sdp_loop_kick(loop, port);
+                port->busy = 0;
+        }
+        loop->running--;
+        sdp_loop_reap(loop);
+
+        return loop->completed - completed;
+}
+
+/**
+ * Get queueing delay statistics of priority classes of device.
+ * @param loop  Pointer to sdp_loop_t structure, initialized by sdp_loop_init.
+ * @param sdp   Pointer to device registered by sdp_loop_add.
+ * @param stats Array indexed by sdp_class_t used to store statistics.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_loop_get_sched_stats(sdp_loop_t *loop, sdp_t *sdp,
+                sdp_sched_stats_t *stats)
+{
+        int idx;
+
+        idx = sdp_loop_find(loop, sdp);
+        if (idx < 0) {
+                errno = ENOENT;
+                return SDP_EERRNO;
+        }
+        sdp_sched_get_stats(&loop->ports[idx]->queue, stats);
+
+        return 0;
+}
+
+#endif
@@ -22,9 +22,6 @@
 #include <math.h>
 #include <string.h>
 
-
-#define SDP_INT2VOLT(u) (((double)(u)) / 10)
-#define SDP_INT2CURR(i) (((double)(i)) / 100)
 #define SDP_VOLT2INT(x) ((int)round((x) * 10))
 #define SDP_CURR2INT(x) ((int)round((x) * 100))
 
@@ -70,6 +67,56 @@ static const char sdp_cmd_stop[] = "STOP__\r";
 
 static const char str_ok[] = "OK\r";
 
+/* command mnemonics, indexed by sdp_op_t */
+static const char sdp_op_names[sdp_op_count][5] = {
+        "",
+        "SESS", "ENDS", "CCOM", "GCOM", "GMAX", "GOVP", "GETD", "GETS",
+        "GETM", "GETM", "GETP", "GETP", "GPAL", "VOLT", "CURR", "SOVP",
+        "SOUT", "POWW", "PROM", "PROP", "RUNM", "RUNP", "STOP",
+};
+
+/* lenght of response, indexed by sdp_op_t, see sdp_resp_* functions */
+static const short sdp_op_resp_lens[sdp_op_count] = {
+        [sdp_op_unknown] = 0,
+        [sdp_op_gcom] = sizeof("___\rOK\r") - 1,
+        [sdp_op_gmax] = sizeof("uuuiii\rOK\r") - 1,
+        [sdp_op_govp] = sizeof("uuu\rOK\r") - 1,
+        [sdp_op_getd] = sizeof("uuuuiiiic\rOK\r") - 1,
+        [sdp_op_gets] = sizeof("uuuiii\rOK\r") - 1,
+        [sdp_op_getm] = sizeof("uuuiii\rOK\r") - 1,
+        [sdp_op_getm_all] = (sizeof("uuuiii\r") - 1) * 9 + SDP_RESP_LEN_OK,
+        [sdp_op_getp] = sizeof("uuuiiimmss\rOK\r") - 1,
+        [sdp_op_getp_all] = (sizeof("uuuiiimmss\r") - 1) * 20 +
+                SDP_RESP_LEN_OK,
+        [sdp_op_gpal] = sizeof("UUUUUUUUVIIIIIIIIAPPPPPPPPWmmmmssss____"
+                        "uuuuuu___iiiiii___pp_________\rOK\r") - 1,
+        [sdp_op_sess] = SDP_RESP_LEN_OK,
+        [sdp_op_ends] = SDP_RESP_LEN_OK,
+        [sdp_op_ccom] = SDP_RESP_LEN_OK,
+        [sdp_op_volt] = SDP_RESP_LEN_OK,
+        [sdp_op_curr] = SDP_RESP_LEN_OK,
+        [sdp_op_sovp] = SDP_RESP_LEN_OK,
+        [sdp_op_sout] = SDP_RESP_LEN_OK,
+        [sdp_op_poww] = SDP_RESP_LEN_OK,
+        [sdp_op_prom] = SDP_RESP_LEN_OK,
+        [sdp_op_prop] = SDP_RESP_LEN_OK,
+        [sdp_op_runm] = SDP_RESP_LEN_OK,
+        [sdp_op_runp] = SDP_RESP_LEN_OK,
+        [sdp_op_stop] = SDP_RESP_LEN_OK,
+};
+
+/* fields provided by reads, indexed by sdp_op_t, see sdp_query_plan */
+static const unsigned int sdp_op_field_masks[sdp_op_count] = {
+        [sdp_op_getd] = SDP_FIELD_VA_DATA,
+        [sdp_op_gets] = SDP_FIELD_SETPOINT,
+        [sdp_op_gpal] = SDP_FIELD_ALL,
+};
+
+/* reads query might be served by, all commands have the same lenght */
+static const sdp_op_t sdp_query_ops[SDP_QUERY_OPS_MAX] = {
+        sdp_op_getd, sdp_op_gets, sdp_op_gpal,
+};
+
 #ifdef _MSVC
 /**
  * Rounds number usign common rounding rules, there is missing of round
@@ -152,6 +199,427 @@ static int sdp_print_cmd(char *buf, const char *cmd, int addr)
         return strlen(cmd);
 }
 
+/**
+ * Identify command prepared by one of sdp_s* functions.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      Command identification, sdp_op_unknown when command is not
+ *      recognized.
+ */
+sdp_op_t sdp_op_id(const char *buf, int len)
+{
+        int op;
+
+        if (len < (int)sizeof(sdp_cmd_stop) - 1)
+                return sdp_op_unknown;
+
+        for (op = sdp_op_unknown + 1; op < sdp_op_count; op++) {
+                if (memcmp(buf, sdp_op_names[op], 4))
+                        continue;
+                if (op == sdp_op_getm && len == sizeof(sdp_cmd_getm) - 1)
+                        return sdp_op_getm_all;
+                if (op == sdp_op_getp && len == sizeof(sdp_cmd_getp) - 1)
+                        return sdp_op_getp_all;
+
+                return (sdp_op_t)op;
+        }
+
+        return sdp_op_unknown;
+}
+
+/**
+ * Get exact lenght of response on command.
+ * @param op    Command identification.
+ * @return      Lenght of response including "OK\r" terminator, 0 when
+ *      command is unknown.
+ */
+int sdp_op_resp_len(sdp_op_t op)
+{
+        if (op < 0 || op >= sdp_op_count)
+                return 0;
+
+        return sdp_op_resp_lens[op];
+}
+
+/**
+ * Get fields of device state provided by read.
+ * @param op    Command identification.
+ * @return      Mask of SDP_FIELD_* values, 0 when command does not provide
+ *      anny field.
+ */
+unsigned int sdp_op_fields(sdp_op_t op)
+{
+        if (op < 0 || op >= sdp_op_count)
+                return 0;
+
+        return sdp_op_field_masks[op];
+}
+
+/**
+ * Get time needed to transfer query command and its response at 9600 Bd.
+ * @param op    Command identification, one of reads providing fields.
+ * @return      Transfer time [us], 0 when command is unknown.
+ */
+long sdp_op_wire_time(sdp_op_t op)
+{
+        if (!sdp_op_resp_len(op))
+                return 0;
+
+        return ((sizeof(sdp_cmd_getd) - 1 + sdp_op_resp_len(op)) *
+                        10l * 1000000l) / 9600l;
+}
+
+/**
+ * Get estimated time of exchange of query command, fixed reaction delay of
+ *      device makes one longer read cheaper than two short ones.
+ * @param op    Command identification, one of reads providing fields.
+ * @return      Time of exchange [us], 0 when command is unknown.
+ */
+long sdp_op_cost(sdp_op_t op)
+{
+        if (!sdp_op_resp_len(op))
+                return 0;
+
+        return sdp_op_wire_time(op) + SDP_REACT_TIME;
+}
+
+/**
+ * Choose the cheapest set of reads which provides all requested fields.
+ *      Ties are broken by lower number of exchanges.
+ * @param fields        Mask of requested SDP_FIELD_* values.
+ * @param cost  Cost of each read indexed by sdp_op_t (for example
+ *      measured round trip time), NULL to use sdp_op_cost.
+ * @param ops   Used to store reads in order they should be send.
+ * @return      Number of reads stored in ops, or negative number
+ *      (error no.) on error.
+ */
+int sdp_query_plan(unsigned int fields, const long *cost,
+                sdp_op_t ops[SDP_QUERY_OPS_MAX])
+{
+        unsigned int set, best = 0, covered;
+        long set_cost, best_cost = 0;
+        int idx, count, best_count = 0;
+        sdp_op_t op;
+
+        if (fields & ~SDP_FIELD_ALL) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+        if (!fields)
+                return 0;
+
+        for (set = 1; set < (1u << SDP_QUERY_OPS_MAX); set++) {
+                covered = 0;
+                set_cost = 0;
+                count = 0;
+                for (idx = 0; idx < SDP_QUERY_OPS_MAX; idx++) {
+                        if (!(set & (1u << idx)))
+                                continue;
+                        op = sdp_query_ops[idx];
+                        covered |= sdp_op_field_masks[op];
+                        set_cost += cost ? cost[op] : sdp_op_cost(op);
+                        count++;
+                }
+                if ((covered & fields) != fields)
+                        continue;
+                if (best && (set_cost > best_cost ||
+                                (set_cost == best_cost && count >= best_count)))
+                        continue;
+                best = set;
+                best_cost = set_cost;
+                best_count = count;
+        }
+
+        count = 0;
+        for (idx = 0; idx < SDP_QUERY_OPS_MAX; idx++) {
+                if (best & (1u << idx))
+                        ops[count++] = sdp_query_ops[idx];
+        }
+
+        return count;
+}
+
+/**
+ * Get exact lenght of response on command prepared by one of sdp_s*
+ *      functions, lenght depends on command and its arguments.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      Lenght of response including "OK\r" terminator, 0 when
+ *      command is not recognized.
+ */
+int sdp_resp_len(const char *buf, int len)
+{
+        return sdp_op_resp_len(sdp_op_id(buf, len));
+}
+
+/**
+ * Get priority class of command prepared by one of sdp_s* functions.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      Priority class, unknown command is sdp_class_control.
+ */
+sdp_class_t sdp_cmd_class(const char *buf, int len)
+{
+        switch (sdp_op_id(buf, len)) {
+        case sdp_op_stop:
+                return sdp_class_safety;
+        case sdp_op_sout:
+                if (len == sizeof(sdp_cmd_sout_dis) - 1 &&
+                                buf[6] == sdp_cmd_sout_dis[6])
+                        return sdp_class_safety;
+                return sdp_class_control;
+        case sdp_op_gcom:
+        case sdp_op_gmax:
+        case sdp_op_govp:
+        case sdp_op_getd:
+        case sdp_op_gets:
+        case sdp_op_gpal:
+                return sdp_class_telemetry;
+        case sdp_op_getm:
+        case sdp_op_getm_all:
+        case sdp_op_getp:
+        case sdp_op_getp_all:
+        case sdp_op_poww:
+        case sdp_op_prom:
+        case sdp_op_prop:
+                return sdp_class_bulk;
+        default:
+                return sdp_class_control;
+        }
+}
+
+static const sdp_caps_t sdp_caps[sdp_model_count] = {
+        /* generic range of three digit encoding */
+        [sdp_model_unknown] = {sdp_model_unknown, "unknown",
+                {.curr = 9.99, .volt = 99.9}},
+        [sdp_model_2210] = {sdp_model_2210, "SDP 2210",
+                {.curr = 9.99, .volt = 20.0}},
+        [sdp_model_2405] = {sdp_model_2405, "SDP 2405",
+                {.curr = 5.0, .volt = 40.0}},
+        [sdp_model_2603] = {sdp_model_2603, "SDP 2603",
+                {.curr = 3.0, .volt = 60.0}},
+};
+
+/**
+ * Get capabilities of model.
+ * @param model Model of power supply.
+ * @return      Capabilities, NULL for unknown model.
+ */
+const sdp_caps_t *sdp_model_caps(sdp_model_t model)
+{
+        if (model <= sdp_model_unknown || model >= sdp_model_count)
+                return NULL;
+
+        return &sdp_caps[model];
+}
+
+/**
+ * Identify model by maximal voltage reported by GMAX, current is not used
+ *      as 10 A model can not report it in three digits.
+ * @param va_maximums   Maximums parsed by sdp_resp_va_maximums.
+ * @return      Model, sdp_model_unknown when no model matches.
+ */
+sdp_model_t sdp_model_identify(const sdp_va_t *va_maximums)
+{
+        int model;
+
+        for (model = sdp_model_unknown + 1; model < sdp_model_count; model++) {
+                if (SDP_VOLT2INT(sdp_caps[model].va_maximums.volt) ==
+                                SDP_VOLT2INT(va_maximums->volt))
+                        return model;
+        }
+
+        return sdp_model_unknown;
+}
+
+/**
+ * Convert voltage to integer send to device, values which are equal after
+ *      conversion are same for device.
+ * @param volt  Voltage [V].
+ * @return      Voltage in units of 0.1 V.
+ */
+int sdp_volt2int(double volt)
+{
+        return SDP_VOLT2INT(volt);
+}
+
+/**
+ * Convert current to integer send to device, values which are equal after
+ *      conversion are same for device.
+ * @param curr  Current [A].
+ * @return      Current in units of 0.01 A.
+ */
+int sdp_curr2int(double curr)
+{
+        return SDP_CURR2INT(curr);
+}
+
+/**
+ * Check voltage setpoint or limit against capabilities of model, value is
+ *      compared after conversion to value send to device.
+ * @param caps  Capabilities of model, NULL when model is not known.
+ * @param volt  Voltage [V].
+ * @return      0 when value is in range, SDP_ERANGE otherwise.
+ */
+int sdp_caps_check_volt(const sdp_caps_t *caps, double volt)
+{
+        int val;
+
+        if (!caps)
+                caps = &sdp_caps[sdp_model_unknown];
+        val = SDP_VOLT2INT(volt);
+        if (val < 0 || val > SDP_VOLT2INT(caps->va_maximums.volt)) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        return 0;
+}
+
+/**
+ * Check current setpoint against capabilities of model, value is compared
+ *      after conversion to value send to device.
+ * @param caps  Capabilities of model, NULL when model is not known.
+ * @param curr  Current [A].
+ * @return      0 when value is in range, SDP_ERANGE otherwise.
+ */
+int sdp_caps_check_curr(const sdp_caps_t *caps, double curr)
+{
+        int val;
+
+        if (!caps)
+                caps = &sdp_caps[sdp_model_unknown];
+        val = SDP_CURR2INT(curr);
+        if (val < 0 || val > SDP_CURR2INT(caps->va_maximums.curr)) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        return 0;
+}
+
+/**
+ * Get decimal number from command.
+ * @param buf   Buffer with command.
+ * @param off   Offset of first digit.
+ * @param digits        Number of digits.
+ * @return      Number, -1 when command does not contain digits at offset.
+ */
+static int sdp_cmd_num(const char *buf, int off, int digits)
+{
+        int val = 0;
+
+        for (; digits; digits--, off++) {
+                if (buf[off] < '0' || buf[off] > '9')
+                        return -1;
+                val = val * 10 + buf[off] - '0';
+        }
+
+        return val;
+}
+
+/**
+ * Check values of command prepared by one of sdp_s* functions (VOLT, CURR,
+ *      SOVP, PROM, PROP) against capabilities of model, used by all paths
+ *      commands are send through, so value out of range never reaches
+ *      device.
+ * @param caps  Capabilities of model, NULL when model is not known.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      0 when values are in range or command does not contain
+ *      setpoint, SDP_ERANGE otherwise.
+ */
+int sdp_caps_check_cmd(const sdp_caps_t *caps, const char *buf, int len)
+{
+        int volt = -1, curr = -1;
+
+        if (!caps)
+                caps = &sdp_caps[sdp_model_unknown];
+
+        switch (sdp_op_id(buf, len)) {
+        case sdp_op_volt:
+        case sdp_op_sovp:
+                if (len != sizeof(sdp_cmd_volt) - 1)
+                        return 0;
+                volt = sdp_cmd_num(buf, 6, 3);
+                break;
+        case sdp_op_curr:
+                if (len != sizeof(sdp_cmd_curr) - 1)
+                        return 0;
+                curr = sdp_cmd_num(buf, 6, 3);
+                break;
+        case sdp_op_prom:
+                if (len != sizeof(sdp_cmd_prom) - 1)
+                        return 0;
+                volt = sdp_cmd_num(buf, 7, 3);
+                curr = sdp_cmd_num(buf, 10, 3);
+                break;
+        case sdp_op_prop:
+                if (len != sizeof(sdp_cmd_prop) - 1)
+                        return 0;
+                volt = sdp_cmd_num(buf, 8, 3);
+                curr = sdp_cmd_num(buf, 11, 3);
+                break;
+        default:
+                return 0;
+        }
+
+        if (volt > SDP_VOLT2INT(caps->va_maximums.volt) ||
+                        curr > SDP_CURR2INT(caps->va_maximums.curr)) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+
+        return 0;
+}
+
+/**
+ * Get device address command prepared by one of sdp_s* functions is send to.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      Device address, 0 when command does not contain address.
+ */
+int sdp_cmd_addr(const char *buf, int len)
+{
+        int addr;
+
+        if (len < 7 || buf[4] < '0' || buf[4] > '9' ||
+                        buf[5] < '0' || buf[5] > '9')
+                return 0;
+        addr = (buf[4] - '0') * 10 + buf[5] - '0';
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX)
+                return 0;
+
+        return addr;
+}
+
+/**
+ * Get value of setpoint write command (VOLT or CURR) as encoded in command.
+ * @param buf   Buffer with command.
+ * @param len   Lenght of command.
+ * @return      Encoded value, -1 when command is not setpoint write.
+ */
+int sdp_cmd_setpoint(const char *buf, int len)
+{
+        sdp_op_t op;
+        int n, val;
+
+        op = sdp_op_id(buf, len);
+        if (op != sdp_op_volt && op != sdp_op_curr)
+                return -1;
+        if (len != sizeof(sdp_cmd_volt) - 1)
+                return -1;
+
+        val = 0;
+        for (n = 6; n < 9; n++) {
+                if (buf[n] < '0' || buf[n] > '9')
+                        return -1;
+                val = val * 10 + buf[n] - '0';
+        }
+
+        return val;
+}
+
 /**
  * Request to get devices RS485 address, might be used to detect whatever is
  *      device with specified address available.
@@ -312,6 +780,8 @@ const char *sdp_strerror(int err)
                         return "Output is too large to fit in buffer.";
                 case SDP_EWINCOMPL:
                         return "Error occured during sending message to device.";
+                case SDP_EDEVDOWN:
+                        return "Device does not respond, request rejected.";
                 case SDP_EOK:
                         errno = 0;
                 case SDP_EERRNO:
@@ -343,6 +813,196 @@ sdp_resp_t sdp_resp(const char *buf, int len)
         return sdp_resp_incomplete;
 }
 
+/* terminator match states of sdp_rx_t, start of response acts as '\r' */
+#define SDP_RX_TERM_NONE        (0)
+#define SDP_RX_TERM_CR          (1)
+#define SDP_RX_TERM_O           (2)
+#define SDP_RX_TERM_K           (3)
+
+/**
+ * Initialize (or reset) response framer, all stored data are dropped.
+ * @param rx    Pointer to sdp_rx_t structure.
+ */
+void sdp_rx_init(sdp_rx_t *rx)
+{
+        rx->head = 0;
+        rx->len = 0;
+        rx->scan = 0;
+        rx->frame = 0;
+        rx->term = SDP_RX_TERM_CR;
+        rx->skip = 0;
+        rx->stale = 0;
+}
+
+/**
+ * Reset framer after request timed out, its response might still arrive
+ *      later and is dropped by sdp_rx_resp.
+ * @param rx    Pointer to sdp_rx_t structure.
+ */
+void sdp_rx_expire(sdp_rx_t *rx)
+{
+        unsigned int stale = rx->stale;
+
+        sdp_rx_init(rx);
+        rx->stale = (stale < SDP_RX_STALE_MAX) ? stale + 1 : stale;
+}
+
+/**
+ * Scan bytes not scanned yet for response terminator, stop on first
+ *      complete response.
+ * @param rx    Pointer to sdp_rx_t structure.
+ */
+static void sdp_rx_scan(sdp_rx_t *rx)
+{
+        while (!rx->frame && rx->scan < rx->len) {
+                char c;
+
+                c = rx->buf[(rx->head + rx->scan) & (SDP_RX_BUF_SIZE - 1)];
+                rx->scan++;
+
+                if (rx->term == SDP_RX_TERM_CR && c == 'O')
+                        rx->term = SDP_RX_TERM_O;
+                else if (rx->term == SDP_RX_TERM_O && c == 'K')
+                        rx->term = SDP_RX_TERM_K;
+                else if (rx->term == SDP_RX_TERM_K && c == '\r')
+                        rx->frame = rx->scan;
+                else if (c == '\r')
+                        rx->term = SDP_RX_TERM_CR;
+                else
+                        rx->term = SDP_RX_TERM_NONE;
+        }
+}
+
+/**
+ * Remove bytes from start of framer buffer. When complete response is
+ *      removed, scanning continues by next response.
+ * @param rx    Pointer to sdp_rx_t structure.
+ * @param count Number of removed bytes, all scanned bytes or lenght of
+ *      complete response.
+ */
+static void sdp_rx_drop(sdp_rx_t *rx, unsigned int count)
+{
+        rx->head = (rx->head + count) & (SDP_RX_BUF_SIZE - 1);
+        rx->len -= count;
+        rx->scan -= count;
+        if (rx->frame) {
+                rx->frame = 0;
+                rx->term = SDP_RX_TERM_CR;
+                sdp_rx_scan(rx);
+        }
+}
+
+/**
+ * Get continuous free space in framer buffer, where new data should be
+ *      readed.
+ * @param rx    Pointer to sdp_rx_t structure.
+ * @param buf   Pointer used to store start of free space.
+ * @return      Number of bytes available at buf, 0 when buffer is full.
+ */
+int sdp_rx_space(sdp_rx_t *rx, char **buf)
+{
+        unsigned int pos, space;
+
+        pos = (rx->head + rx->len) & (SDP_RX_BUF_SIZE - 1);
+        space = SDP_RX_BUF_SIZE - rx->len;
+        if (space > SDP_RX_BUF_SIZE - pos)
+                space = SDP_RX_BUF_SIZE - pos;
+        *buf = rx->buf + pos;
+
+        return space;
+}
+
+/**
+ * Notify framer about count bytes stored into space returned by
+ *      sdp_rx_space and scan them for response terminator.
+ * @param rx    Pointer to sdp_rx_t structure.
+ * @param count Number of bytes stored.
+ * @return      Lenght of complete response, or 0 when response is not
+ *      complete yet.
+ */
+int sdp_rx_commit(sdp_rx_t *rx, int count)
+{
+        rx->len += count;
+        sdp_rx_scan(rx);
+
+        return rx->frame;
+}
+
+/**
+ * Remove complete response from framer and copy it into buffer. Bytes
+ *      recieved after response are kept for next call.
+ * @param rx    Pointer to sdp_rx_t structure.
+ * @param buf   Buffer used to store response.
+ * @param size  Size of buf.
+ * @return      Lenght of response, 0 when no complete response is available,
+ *      or negative number (error no.) when response does not fit into buf,
+ *      response is dropped in this case. Incomplete response is dropped
+ *      as soon as it is longer than buf.
+ */
+int sdp_rx_frame(sdp_rx_t *rx, char *buf, int size)
+{
+        unsigned int frame, part;
+
+        /* drop end of response rejected as too long */
+        if (rx->skip && rx->frame) {
+                sdp_rx_drop(rx, rx->frame);
+                rx->skip = 0;
+        }
+
+        frame = rx->frame;
+        if (!frame) {
+                if (!rx->skip && rx->len < (unsigned int)size)
+                        return 0;
+                /* garbage, response can not fit into buf anymore, drop it
+                 * until terminator is found */
+                sdp_rx_drop(rx, rx->len);
+                if (rx->skip)
+                        return 0;
+                rx->skip = 1;
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+
+        if (frame > (unsigned int)size) {
+                sdp_rx_drop(rx, frame);
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+
+        part = SDP_RX_BUF_SIZE - rx->head;
+        if (part > frame)
+                part = frame;
+        memcpy(buf, rx->buf + rx->head, part);
+        memcpy(buf + part, rx->buf, frame - part);
+        sdp_rx_drop(rx, frame);
+
+        return frame;
+}
+
+/**
+ * Get response of request in progress. Like sdp_rx_frame, but while late
+ *      responses of timed out requests are expected, responses of other
+ *      lenght than expected are dropped.
+ * @param rx    Pointer to sdp_rx_t structure.
+ * @param buf   Buffer used to store response.
+ * @param size  Size of buf, lenght of expected response when exact is set.
+ * @param exact 1 when lenght of response is known exactly.
+ * @return      Lenght of response, 0 when no complete response is available,
+ *      or negative number (error no.) on error.
+ */
+int sdp_rx_resp(sdp_rx_t *rx, char *buf, int size, int exact)
+{
+        int ret;
+
+        while ( (ret = sdp_rx_frame(rx, buf, size))) {
+                if (!exact || !rx->stale || ret == size)
+                        break;
+                rx->stale--;
+        }
+
+        return ret;
+}
+
 /**
  * Parse response on sdp_sget_dev_addr. When device is connected on
  *      RS485 bus, this function might be used to check for presence of device
@@ -0,0 +1,195 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_mirror.h"
+
+#include <errno.h>
+#include <string.h>
+
+/**
+ * Compare values as they are send on wire.
+ * @param volt  Voltage stored in mirror [V].
+ * @param curr  Current stored in mirror [A].
+ * @param volt_ Wanted voltage [V].
+ * @param curr_ Wanted current [A].
+ * @return      1 when values are same for device, 0 otherwise.
+ */
+static int sdp_mirror_equal(double volt, double curr, double volt_,
+                double curr_)
+{
+        return sdp_volt2int(volt) == sdp_volt2int(volt_) &&
+                sdp_curr2int(curr) == sdp_curr2int(curr_);
+}
+
+/**
+ * Initialize empty mirror, all slots are written on first sync unless
+ *      sdp_mirror_load is called.
+ * @param mirror        Pointer to uninitialized sdp_mirror_t structure.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ */
+void sdp_mirror_init(sdp_mirror_t *mirror, sdp_t *sdp)
+{
+        memset(mirror, 0, sizeof(*mirror));
+        mirror->sdp = sdp;
+}
+
+/**
+ * Load all presets and program items, GETM and GETP of all slots are used.
+ * @param mirror        Pointer to sdp_mirror_t structure, initialized by
+ *      sdp_mirror_init.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_mirror_load(sdp_mirror_t *mirror)
+{
+        int ret;
+
+        memset(mirror->preset_valid, 0, sizeof(mirror->preset_valid));
+        memset(mirror->program_valid, 0, sizeof(mirror->program_valid));
+
+        if ( (ret = sdp_get_preset(mirror->sdp, SDP_PRESET_ALL,
+                                        mirror->preset)) < 0)
+                return ret;
+        memset(mirror->preset_valid, 1, sizeof(mirror->preset_valid));
+
+        if ( (ret = sdp_get_program(mirror->sdp, SDP_PROGRAM_ALL,
+                                        mirror->program)) < 0)
+                return ret;
+        memset(mirror->program_valid, 1, sizeof(mirror->program_valid));
+
+        return 0;
+}
+
+/**
+ * Set preset, it is writen only when it differs from mirror.
+ * @param mirror        Pointer to sdp_mirror_t structure, initialized by
+ *      sdp_mirror_init.
+ * @param presn Number of preset (1 - 9).
+ * @param va_preset     Wanted value of preset.
+ * @return      1 when preset was writen, 0 when it was already equal,
+ *      negative number (error no.) on error.
+ */
+int sdp_mirror_set_preset(sdp_mirror_t *mirror, int presn,
+                const sdp_va_t *va_preset)
+{
+        sdp_va_t *cur;
+        int idx, ret;
+
+        if (presn < SDP_PRESET_MIN || presn > SDP_PRESET_MAX) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+        idx = presn - SDP_PRESET_MIN;
+        cur = &mirror->preset[idx];
+
+        if (mirror->preset_valid[idx] &&
+                        sdp_mirror_equal(cur->volt, cur->curr,
+                                va_preset->volt, va_preset->curr)) {
+                mirror->skipped++;
+                return 0;
+        }
+
+        /* result of failed write is not known */
+        mirror->preset_valid[idx] = 0;
+        if ( (ret = sdp_set_preset(mirror->sdp, presn, va_preset)) < 0)
+                return ret;
+
+        cur->volt = SDP_INT2VOLT(sdp_volt2int(va_preset->volt));
+        cur->curr = SDP_INT2CURR(sdp_curr2int(va_preset->curr));
+        mirror->preset_valid[idx] = 1;
+        mirror->writes++;
+
+        return 1;
+}
+
+/**
+ * Set program item, it is writen only when it differs from mirror.
+ * @param mirror        Pointer to sdp_mirror_t structure, initialized by
+ *      sdp_mirror_init.
+ * @param progn Number of program item (0 - 19).
+ * @param program       Wanted value of program item.
+ * @return      1 when item was writen, 0 when it was already equal,
+ *      negative number (error no.) on error.
+ */
+int sdp_mirror_set_program(sdp_mirror_t *mirror, int progn,
+                const sdp_program_t *program)
+{
+        sdp_program_t *cur;
+        int idx, ret;
+
+        if (progn < SDP_PROGRAM_MIN || progn > SDP_PROGRAM_MAX) {
+                errno = ERANGE;
+                return SDP_ERANGE;
+        }
+        idx = progn - SDP_PROGRAM_MIN;
+        cur = &mirror->program[idx];
+
+        if (mirror->program_valid[idx] && cur->time == program->time &&
+                        sdp_mirror_equal(cur->volt, cur->curr,
+                                program->volt, program->curr)) {
+                mirror->skipped++;
+                return 0;
+        }
+
+        mirror->program_valid[idx] = 0;
+        if ( (ret = sdp_set_program(mirror->sdp, progn, program)) < 0)
+                return ret;
+
+        cur->volt = SDP_INT2VOLT(sdp_volt2int(program->volt));
+        cur->curr = SDP_INT2CURR(sdp_curr2int(program->curr));
+        cur->time = program->time;
+        mirror->program_valid[idx] = 1;
+        mirror->writes++;
+
+        return 1;
+}
+
+/**
+ * Make device memory equal to wanted image, only differing slots are
+ *      writen.
+ * @param mirror        Pointer to sdp_mirror_t structure, initialized by
+ *      sdp_mirror_init.
+ * @param presets       Array of SDP_PRESET_COUNT wanted presets, NULL to
+ *      keep presets.
+ * @param programs      Array of SDP_PROGRAM_COUNT wanted program items,
+ *      NULL to keep program.
+ * @return      Number of writen slots, negative number (error no.) on
+ *      error.
+ */
+int sdp_mirror_sync(sdp_mirror_t *mirror, const sdp_va_t *presets,
+                const sdp_program_t *programs)
+{
+        int idx, ret, count = 0;
+
+        for (idx = 0; presets && idx < SDP_PRESET_COUNT; idx++) {
+                ret = sdp_mirror_set_preset(mirror, idx + SDP_PRESET_MIN,
+                                &presets[idx]);
+                if (ret < 0)
+                        return ret;
+                count += ret;
+        }
+
+        for (idx = 0; programs && idx < SDP_PROGRAM_COUNT; idx++) {
+                ret = sdp_mirror_set_program(mirror, idx + SDP_PROGRAM_MIN,
+                                &programs[idx]);
+                if (ret < 0)
+                        return ret;
+                count += ret;
+        }
+
+        return count;
+}
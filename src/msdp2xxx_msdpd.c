@@ -0,0 +1,271 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+/* struct ucred */
+#define _GNU_SOURCE
+
+#include "msdp2xxx_msdpd.h"
+#include "msdp2xxx_low.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** Time daemon has to answer in addition to response timeout [ms]. */
+#define SDP_MSDPD_TIMEOUT_MS (1000)
+
+/**
+ * Wait for answer of daemon, late answers on previous requests are dropped.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_msdpd_open.
+ * @param seq   Sequence number of request.
+ * @param buf   Buffer to store response.
+ * @param size  Size of buf.
+ * @param timeout       Time to wait [ms].
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+static int sdp_msdpd_recv(sdp_t *sdp, unsigned int seq, char *buf, int size,
+                int timeout)
+{
+        struct pollfd pfd = { .fd = sdp->f_in, .events = POLLIN, };
+        sdp_msdpd_hdr_t hdr;
+        struct iovec iov[2];
+        struct msghdr msg;
+        long long deadline;
+        ssize_t ret;
+
+        deadline = sdp_time_us() + timeout * 1000ll;
+        do {
+                timeout = (deadline - sdp_time_us() + 999) / 1000;
+                sdp->io.syscalls++;
+                ret = poll(&pfd, 1, (timeout > 0) ? timeout : 0);
+                if (ret <= 0) {
+                        if (ret == 0)
+                                errno = ETIMEDOUT;
+                        return SDP_ETIMEDOUT;
+                }
+                sdp->io.wakeups++;
+
+                iov[0].iov_base = &hdr;
+                iov[0].iov_len = sizeof(hdr);
+                iov[1].iov_base = buf;
+                iov[1].iov_len = size;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iov;
+                msg.msg_iovlen = 2;
+
+                sdp->io.syscalls++;
+                ret = recvmsg(sdp->f_in, &msg, 0);
+                if (ret < (ssize_t)sizeof(hdr)) {
+                        if (ret >= 0)
+                                errno = EIO;
+                        return SDP_EERRNO;
+                }
+        } while (hdr.seq != seq);
+
+        if (msg.msg_flags & MSG_TRUNC) {
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+        if (hdr.ret < 0) {
+                errno = hdr.err;
+                return hdr.ret;
+        }
+        if (hdr.ret != ret - (ssize_t)sizeof(hdr)) {
+                errno = EIO;
+                return SDP_EERRNO;
+        }
+        sdp->io.frames++;
+
+        return hdr.ret;
+}
+
+/**
+ * Get default path of daemon socket - value of MSDPD_SOCKET environment
+ *      variable, msdpd.sock in XDG_RUNTIME_DIR or SDP_MSDPD_SOCKET. Shared
+ *      directories as /tmp are not used, other user might create socket
+ *      there.
+ * @param buf   Buffer used to store path.
+ * @param size  Size of buf.
+ * @return      On success 0, on error negative number (error no.).
+ */
+int sdp_msdpd_socket(char *buf, int size)
+{
+        const char *dir;
+        int len;
+
+        if ( (dir = getenv(SDP_MSDPD_SOCKET_ENV)))
+                len = snprintf(buf, size, "%s", dir);
+        else if ( (dir = getenv("XDG_RUNTIME_DIR")) && dir[0])
+                len = snprintf(buf, size, "%s/" SDP_MSDPD_SOCKET_NAME, dir);
+        else
+                len = snprintf(buf, size, "%s", SDP_MSDPD_SOCKET);
+        if (len < 0 || len >= size) {
+                errno = ENAMETOOLONG;
+                return SDP_EERRNO;
+        }
+
+        return 0;
+}
+
+/**
+ * Check that daemon socket is owned by the user or root, socket created
+ *      by other user must not get commands of this user.
+ * @param fd    Connected socket.
+ * @param path  Path of socket.
+ * @return      On success 0, on error -1 and errno is set.
+ */
+static int sdp_msdpd_check_owner(int fd, const char *path)
+{
+        struct ucred cred;
+        socklen_t len = sizeof(cred);
+        struct stat st;
+
+        if (lstat(path, &st) < 0)
+                return -1;
+        if (!S_ISSOCK(st.st_mode) ||
+                        (st.st_uid != geteuid() && st.st_uid != 0)) {
+                errno = EACCES;
+                return -1;
+        }
+        /* path might be replaced between lstat and connect */
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0)
+                return -1;
+        if (cred.uid != geteuid() && cred.uid != 0) {
+                errno = EACCES;
+                return -1;
+        }
+
+        return 0;
+}
+
+/**
+ * Connect to msdpd daemon serving serial port. Handle is used as the one
+ *      opened by sdp_open, except sdp_batch_run which is not supported.
+ * @param sdp   Pointer to uninitialized sdp_t structure.
+ * @param sock  Path of daemon socket, NULL for default, see
+ *      sdp_msdpd_socket.
+ * @param fname Name of serial port.
+ * @param addr  RS485 address of device, for RS232 is ignored - use anny valid.
+ * @return      On success 0, on error negative number (error no.),
+ *      ENOENT or ECONNREFUSED when daemon is not running, ENODEV when
+ *      daemon does not serve the port, EACCES when socket is owned by other
+ *      user.
+ */
+int sdp_msdpd_open(sdp_t *sdp, const char *sock, const char *fname, int addr)
+{
+        struct sockaddr_un sa;
+        sdp_msdpd_hello_t hello;
+        int fd, ret, e;
+
+        memset(&sa, 0, sizeof(sa));
+        if (!sock) {
+                if ( (ret = sdp_msdpd_socket(sa.sun_path,
+                                                sizeof(sa.sun_path))) < 0)
+                        return ret;
+                sock = sa.sun_path;
+        }
+        if (strlen(sock) >= sizeof(sa.sun_path) ||
+                        strlen(fname) >= sizeof(hello.port)) {
+                errno = ENAMETOOLONG;
+                return SDP_EERRNO;
+        }
+
+        fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+                return SDP_EERRNO;
+
+        if (sock != sa.sun_path)
+                strcpy(sa.sun_path, sock);
+        sa.sun_family = AF_UNIX;
+        if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0)
+                goto err;
+        if (sdp_msdpd_check_owner(fd, sa.sun_path) < 0)
+                goto err;
+
+        if ( (ret = sdp_openf(sdp, fd, addr)) < 0)
+                goto err;
+        sdp->msdpd = 1;
+
+        memset(&hello, 0, sizeof(hello));
+        hello.magic = SDP_MSDPD_MAGIC;
+        strcpy(hello.port, fname);
+        if (send(fd, &hello, sizeof(hello), MSG_NOSIGNAL) < 0)
+                goto err;
+        if ( (ret = sdp_msdpd_recv(sdp, 0, NULL, 0,
+                                        SDP_MSDPD_TIMEOUT_MS)) < 0)
+                goto err;
+
+        return 0;
+
+err:
+        e = errno;
+        close(fd);
+        errno = e;
+        return SDP_EERRNO;
+}
+
+/**
+ * Exchange command with device through msdpd daemon.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_msdpd_open.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+int sdp_msdpd_xfer(sdp_t *sdp, char *buf, int len, int size)
+{
+        sdp_msdpd_req_t req;
+        struct iovec iov[2];
+        struct msghdr msg;
+        sdp_op_t op;
+        long timeout;
+
+        op = sdp_op_id(buf, len);
+        timeout = sdp_resp_timeout(sdp, op, size) / 1000;
+
+        /* 0 is sequence number of hello */
+        if (!++sdp->msdpd_seq)
+                sdp->msdpd_seq++;
+        req.seq = sdp->msdpd_seq;
+        iov[0].iov_base = &req;
+        iov[0].iov_len = sizeof(req);
+        iov[1].iov_base = buf;
+        iov[1].iov_len = len;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        sdp->io.syscalls++;
+        if (sendmsg(sdp->f_out, &msg, MSG_NOSIGNAL) !=
+                        (ssize_t)(sizeof(req) + len))
+                return SDP_EERRNO;
+
+        return sdp_msdpd_recv(sdp, req.seq, buf, size,
+                        timeout + SDP_MSDPD_TIMEOUT_MS);
+}
+
+#endif
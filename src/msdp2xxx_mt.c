@@ -0,0 +1,320 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_mt.h"
+#include "msdp2xxx_sched.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * State of thread-safe mode of sdp_t. Producers push requests on lock-free
+ *      stack, owner thread moves them into priority queue in order of
+ *      submission and exchanges requests with device one by one, the one
+ *      of the highest priority class first.
+ */
+struct sdp_mt {
+        /** device */
+        sdp_t *sdp;
+        /** last submitted request, requests are linked by next */
+        sdp_req_t *head;
+        /** requests taken from stack, accessed only by owner */
+        sdp_sched_t sched;
+        /** posted when request is pushed on empty stack */
+        sem_t wake;
+        /** thread which owns serial port */
+        pthread_t owner;
+        /** set when owner thread should exit */
+        int stop;
+};
+
+/**
+ * Request of synchronous call, waiting caller is woken by completion.
+ */
+typedef struct {
+        sdp_req_t req;
+        sem_t done;
+} sdp_mt_call_t;
+
+/**
+ * Complete request, when stop is requested request fails with ECANCELED.
+ * @param mt    Pointer to sdp_mt structure.
+ * @param req   Request to process.
+ */
+static void sdp_mt_process(struct sdp_mt *mt, sdp_req_t *req)
+{
+        if (__atomic_load_n(&mt->stop, __ATOMIC_ACQUIRE)) {
+                req->ret = SDP_EERRNO;
+                req->err = ECANCELED;
+        } else {
+                sdp_req_run(mt->sdp, req);
+        }
+
+        if (req->cb)
+                req->cb(req);
+}
+
+/**
+ * Take all submitted requests.
+ * @param mt    Pointer to sdp_mt structure.
+ * @return      List of requests in order of submission.
+ */
+static sdp_req_t *sdp_mt_take(struct sdp_mt *mt)
+{
+        sdp_req_t *list, *next, *fifo = NULL;
+
+        list = __atomic_exchange_n(&mt->head, NULL, __ATOMIC_ACQUIRE);
+        /* stack holds newest request first */
+        while (list) {
+                next = list->next;
+                list->next = fifo;
+                fifo = list;
+                list = next;
+        }
+
+        return fifo;
+}
+
+/**
+ * Owner thread, the only one which access serial port.
+ * @param arg   Pointer to sdp_mt structure.
+ * @return      NULL.
+ */
+static void *sdp_mt_owner(void *arg)
+{
+        struct sdp_mt *mt = arg;
+        sdp_req_t *req, *next, *old;
+
+        for (;;) {
+                /* requests submitted during exchange are queued before
+                 * next one is chosen */
+                for (req = sdp_mt_take(mt); req; req = next) {
+                        next = req->next;
+                        old = sdp_sched_push(&mt->sched, req,
+                                        &mt->sdp->shadow);
+                        if (old && old->cb)
+                                old->cb(old);
+                }
+
+                req = sdp_sched_pop(&mt->sched);
+                if (req) {
+                        sdp_mt_process(mt, req);
+                        continue;
+                }
+
+                if (__atomic_load_n(&mt->stop, __ATOMIC_ACQUIRE))
+                        break;
+                while (sem_wait(&mt->wake) < 0 && errno == EINTR)
+                        ;
+        }
+
+        return NULL;
+}
+
+/**
+ * Switch sdp_t into thread-safe mode. Thread owning serial port is
+ *      started, all operations on sdp (sdp_get_*, sdp_set_*, ...) are then
+ *      queued and executed by this thread one by one, so any number of
+ *      threads might use sdp at the same time. Error of failed operation is
+ *      stored in errno of calling thread.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_mt_start(sdp_t *sdp)
+{
+        struct sdp_mt *mt;
+        int ret;
+
+        if (sdp->mt) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+
+        mt = malloc(sizeof(*mt));
+        if (!mt)
+                return SDP_EERRNO;
+        mt->sdp = sdp;
+        mt->head = NULL;
+        sdp_sched_init(&mt->sched);
+        mt->stop = 0;
+        if (sem_init(&mt->wake, 0, 0) < 0) {
+                free(mt);
+                return SDP_EERRNO;
+        }
+
+        ret = pthread_create(&mt->owner, NULL, sdp_mt_owner, mt);
+        if (ret) {
+                sem_destroy(&mt->wake);
+                free(mt);
+                errno = ret;
+                return SDP_EERRNO;
+        }
+        sdp->mt = mt;
+
+        return 0;
+}
+
+/**
+ * Leave thread-safe mode, requests not processed yet fail with ECANCELED.
+ *      No other thread might use sdp during and after this call.
+ * @param sdp   Pointer to sdp_t structure.
+ */
+void sdp_mt_stop(sdp_t *sdp)
+{
+        struct sdp_mt *mt = sdp->mt;
+        sdp_req_t *req, *next;
+
+        if (!mt)
+                return;
+
+        __atomic_store_n(&mt->stop, 1, __ATOMIC_RELEASE);
+        sem_post(&mt->wake);
+        pthread_join(mt->owner, NULL);
+
+        for (req = sdp_mt_take(mt); req; req = next) {
+                next = req->next;
+                req->next = NULL;
+                sdp_mt_process(mt, req);
+        }
+
+        sdp->mt = NULL;
+        sem_destroy(&mt->wake);
+        free(mt);
+}
+
+/**
+ * Submit request to device in thread-safe mode, might be called from
+ *      anny thread. Request is completed by owner thread, req->cb is
+ *      called from it.
+ * @param sdp   Pointer to sdp_t structure, switched by sdp_mt_start.
+ * @param req   Request with prepared command.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_mt_submit(sdp_t *sdp, sdp_req_t *req)
+{
+        struct sdp_mt *mt = sdp->mt;
+        sdp_req_t *head;
+
+        if (!mt) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        req->sdp = sdp;
+        head = __atomic_load_n(&mt->head, __ATOMIC_RELAXED);
+        do {
+                req->next = head;
+        } while (!__atomic_compare_exchange_n(&mt->head, &head, req, 1,
+                                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+        /* owner empties whole stack, so only first request wakes it */
+        if (!head)
+                sem_post(&mt->wake);
+
+        return 0;
+}
+
+/**
+ * Completion callback of synchronous call.
+ * @param req   Completed request.
+ */
+static void sdp_mt_done(sdp_req_t *req)
+{
+        sdp_mt_call_t *call = req->priv;
+
+        sem_post(&call->done);
+}
+
+/**
+ * Send command to device and recieve response in thread-safe mode, calling
+ *      thread is blocked until owner thread completes exchange.
+ * @param sdp   Pointer to sdp_t structure, switched by sdp_mt_start.
+ * @param buf   Buffer with command, used to store response.
+ * @param len   Lenght of command.
+ * @param size  Size of buf.
+ * @return      Lenght of response, or negative number (error no.) on error,
+ *      errno of calling thread is set.
+ */
+int sdp_mt_xfer(sdp_t *sdp, char *buf, int len, int size)
+{
+        struct sdp_mt *mt = sdp->mt;
+        sdp_mt_call_t call;
+        int ret;
+
+        if (len > (int)sizeof(call.req.cmd)) {
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+        memcpy(call.req.cmd, buf, len);
+        call.req.cmd_len = len;
+
+        /* called from completion callback, owner is this thread */
+        if (mt && pthread_equal(pthread_self(), mt->owner)) {
+                call.req.cb = NULL;
+                sdp_req_run(sdp, &call.req);
+        } else {
+                call.req.cb = sdp_mt_done;
+                call.req.priv = &call;
+                if (sem_init(&call.done, 0, 0) < 0)
+                        return SDP_EERRNO;
+                if ( (ret = sdp_mt_submit(sdp, &call.req)) < 0) {
+                        sem_destroy(&call.done);
+                        return ret;
+                }
+                while (sem_wait(&call.done) < 0 && errno == EINTR)
+                        ;
+                sem_destroy(&call.done);
+        }
+
+        ret = call.req.ret;
+        if (ret > size) {
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+        if (ret < 0) {
+                errno = call.req.err;
+                return ret;
+        }
+        memcpy(buf, call.req.resp, ret);
+
+        return ret;
+}
+
+/**
+ * Get queueing delay statistics of priority classes in thread-safe mode.
+ * @param sdp   Pointer to sdp_t structure, switched by sdp_mt_start.
+ * @param stats Array indexed by sdp_class_t used to store statistics.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_mt_get_sched_stats(sdp_t *sdp, sdp_sched_stats_t *stats)
+{
+        if (!sdp->mt) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        sdp_sched_get_stats(&sdp->mt->sched, stats);
+
+        return 0;
+}
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_poll.h"
+#include "msdp2xxx_low.h"
+
+#include <errno.h>
+#include <string.h>
+
+/**
+ * Initialize poller without anny targets.
+ * @param poll  Pointer to uninitialized sdp_poll_t structure.
+ * @param sdp   Port devices are connected to, initialized by sdp_open,
+ *      sdp_select_ifce(sdp, sdp_ifce_rs485) should be already called.
+ */
+void sdp_poll_init(sdp_poll_t *poll, sdp_t *sdp)
+{
+        memset(poll, 0, sizeof(*poll));
+        poll->sdp = sdp;
+}
+
+/**
+ * Prepare polling command.
+ * @param buf   Buffer used to store command.
+ * @param addr  Device address.
+ * @param op    Reading command.
+ * @return      Lenght of command, or negative number (error no.) on error.
+ */
+static int sdp_poll_cmd(char *buf, int addr, sdp_op_t op)
+{
+        switch (op) {
+        case sdp_op_gcom:
+                return sdp_sget_dev_addr(buf, addr);
+        case sdp_op_gmax:
+                return sdp_sget_va_maximums(buf, addr);
+        case sdp_op_govp:
+                return sdp_sget_volt_limit(buf, addr);
+        case sdp_op_getd:
+                return sdp_sget_va_data(buf, addr);
+        case sdp_op_gets:
+                return sdp_sget_va_setpoint(buf, addr);
+        case sdp_op_gpal:
+                return sdp_sget_lcd_info(buf, addr);
+        default:
+                break;
+        }
+
+        errno = EINVAL;
+        return SDP_EERRNO;
+}
+
+/**
+ * Set polling target of device.
+ * @param poll  Pointer to sdp_poll_t structure, initialized by sdp_poll_init.
+ * @param addr  Device address.
+ * @param op    Reading command used to poll device, one of sdp_op_gcom,
+ *      sdp_op_gmax, sdp_op_govp, sdp_op_getd, sdp_op_gets or sdp_op_gpal.
+ * @param period        Requested polling period [us], 0 stops polling.
+ * @param cb    Callback called with completed request after each poll,
+ *      response is parsed by sdp_resp_* function corresponding to op.
+ * @param priv  User data stored in req->priv.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_poll_set(sdp_poll_t *poll, int addr, sdp_op_t op, long period,
+                sdp_req_cb_t cb, void *priv)
+{
+        sdp_poll_dev_t *dev;
+        sdp_rtt_t *rtt;
+        int ret;
+
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX ||
+                        period < 0) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        dev = &poll->dev[addr];
+        if (!period) {
+                dev->period = 0;
+                return 0;
+        }
+        if ( (ret = sdp_poll_cmd(dev->req.cmd, addr, op)) < 0)
+                return ret;
+
+        dev->req.cmd_len = ret;
+        dev->req.cb = cb;
+        dev->req.priv = priv;
+        dev->req.sdp = poll->sdp;
+        if (!dev->period) {
+                dev->due = sdp_time_us();
+                dev->ready = 0;
+                dev->finish = poll->vtime;
+        }
+        dev->period = period;
+
+        /* until first exchange expect time of transfer at 9600 Bd */
+        rtt = &poll->sdp->rtt[op];
+        if (rtt->samples)
+                dev->stats.est = rtt->srtt;
+        else
+                dev->stats.est = ((ret + sdp_op_resp_len(op)) * 10l *
+                                1000000l) / 9600l;
+
+        return 0;
+}
+
+/**
+ * Poll device which is due and has the lowest virtual start time. This
+ *      function does not sleep, when no device is due time to next poll
+ *      is returned. Not usable in thread-safe mode (see sdp_mt_start).
+ * @param poll  Pointer to sdp_poll_t structure, initialized by sdp_poll_init.
+ * @param wait  Used to store time until next device is due [us] when no
+ *      device was polled, -1 when there are no targets.
+ * @return      1 when device was polled, 0 when no device is due,
+ *      negative number (error no.) on error.
+ */
+int sdp_poll_step(sdp_poll_t *poll, long *wait)
+{
+        sdp_poll_dev_t *dev, *best = NULL;
+        long long now, start, due, next = -1;
+        sdp_breaker_t *breaker;
+        unsigned long missed;
+        long cost;
+        int addr;
+
+        if (poll->sdp->mt) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+
+        now = sdp_time_us();
+        for (addr = SDP_DEV_ADDR_MIN; addr <= SDP_DEV_ADDR_MAX; addr++) {
+                dev = &poll->dev[addr];
+                if (!dev->period)
+                        continue;
+                due = dev->due;
+                /* device which does not respond is skipped until its
+                 * circuit breaker allows probe */
+                breaker = &poll->sdp->breaker[addr];
+                if (breaker->state == sdp_breaker_open &&
+                                breaker->retry > due)
+                        due = breaker->retry;
+                if (due > now) {
+                        if (next < 0 || due < next)
+                                next = due;
+                        continue;
+                }
+                /* device joins queue, its start tag can not be before
+                 * current virtual time */
+                if (!dev->ready) {
+                        dev->start = (dev->finish > poll->vtime) ?
+                                dev->finish : poll->vtime;
+                        dev->ready = 1;
+                }
+                if (!best || dev->start < best->start)
+                        best = dev;
+        }
+
+        if (!best) {
+                *wait = (next < 0) ? -1 : (long)(next - now);
+                return 0;
+        }
+
+        /* periods which are over are dropped, not served in burst */
+        missed = (now - best->due) / best->period;
+        if (missed) {
+                best->stats.missed += missed;
+                poll->missed += missed;
+        }
+        best->due += (missed + 1) * best->period;
+        best->ready = 0;
+        poll->vtime = best->start;
+
+        start = sdp_time_us();
+        sdp_req_run(poll->sdp, &best->req);
+        cost = sdp_time_us() - start;
+
+        /* charge actual bus time against budget of device, est / period
+         * of bus time per unit of virtual time */
+        best->finish = best->start +
+                (long long)cost * best->period / best->stats.est;
+        best->stats.est += (cost - best->stats.est) / 8;
+        if (best->stats.est < 1)
+                best->stats.est = 1;
+        best->stats.polls++;
+        if (best->req.ret < 0)
+                best->stats.errors++;
+        best->stats.wire += cost;
+        poll->busy += cost;
+
+        if (best->req.cb)
+                best->req.cb(&best->req);
+
+        return 1;
+}
+
+/**
+ * Get statistics of whole bus.
+ * @param poll  Pointer to sdp_poll_t structure, initialized by sdp_poll_init.
+ * @param stats Pointer to sdp_poll_stats_t used to store statistics.
+ */
+void sdp_poll_get_stats(sdp_poll_t *poll, sdp_poll_stats_t *stats)
+{
+        sdp_poll_dev_t *dev;
+        int addr;
+
+        stats->demand = 0;
+        for (addr = SDP_DEV_ADDR_MIN; addr <= SDP_DEV_ADDR_MAX; addr++) {
+                dev = &poll->dev[addr];
+                if (dev->period)
+                        stats->demand += (double)dev->stats.est / dev->period;
+        }
+        stats->busy = poll->busy;
+        stats->missed = poll->missed;
+}
+
+/**
+ * Get statistics of polling of one device.
+ * @param poll  Pointer to sdp_poll_t structure, initialized by sdp_poll_init.
+ * @param addr  Device address.
+ * @param stats Pointer to sdp_poll_dev_stats_t used to store statistics.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_poll_get_dev_stats(sdp_poll_t *poll, int addr,
+                sdp_poll_dev_stats_t *stats)
+{
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        *stats = poll->dev[addr].stats;
+
+        return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_sched.h"
+#include "msdp2xxx_low.h"
+
+#ifdef __linux__
+
+#include <string.h>
+
+/**
+ * Initialize empty queue.
+ * @param sched Pointer to uninitialized sdp_sched_t structure.
+ */
+void sdp_sched_init(sdp_sched_t *sched)
+{
+        memset(sched, 0, sizeof(*sched));
+}
+
+/**
+ * Find queued setpoint write superseded by new request. Only last request
+ *      of class might be replaced, replacing earlier one would send new value
+ *      before requests queued after it (e.g. VOLT before SOUT).
+ * @param sched Pointer to sdp_sched_t structure.
+ * @param req   New request.
+ * @param prev  Used to store request preceding found one, NULL when found
+ *      request is first.
+ * @return      Queued write of the same setpoint of the same device, NULL
+ *      when there is none.
+ */
+static sdp_req_t *sdp_sched_find(sdp_sched_t *sched, sdp_req_t *req,
+                sdp_req_t **prev)
+{
+        sdp_req_t *it, *tail = sched->tail[req->cls];
+
+        if (!tail || sdp_cmd_setpoint(req->cmd, req->cmd_len) < 0)
+                return NULL;
+        /* operation and address are the same */
+        if (tail->cmd_len != req->cmd_len || memcmp(tail->cmd, req->cmd, 6) ||
+                        sdp_cmd_setpoint(tail->cmd, tail->cmd_len) < 0)
+                return NULL;
+
+        *prev = NULL;
+        for (it = sched->head[req->cls]; it != tail; it = it->next)
+                *prev = it;
+
+        return tail;
+}
+
+/**
+ * Check whatever bulk request changing state of device (POWW, PROM, PROP or
+ *      request queued by sdp_sched_push as bulk) is queued for the same
+ *      device as new request.
+ * @param sched Pointer to sdp_sched_t structure.
+ * @param req   New request.
+ * @return      1 when such request is queued, 0 otherwise.
+ */
+static int sdp_sched_bulk_write(sdp_sched_t *sched, sdp_req_t *req)
+{
+        int addr = sdp_cmd_addr(req->cmd, req->cmd_len);
+        sdp_req_t *it;
+
+        for (it = sched->head[sdp_class_bulk]; it; it = it->next) {
+                if (sdp_cmd_addr(it->cmd, it->cmd_len) != addr)
+                        continue;
+                switch (sdp_op_id(it->cmd, it->cmd_len)) {
+                case sdp_op_getm:
+                case sdp_op_getm_all:
+                case sdp_op_getp:
+                case sdp_op_getp_all:
+                        break;
+                default:
+                        return 1;
+                }
+        }
+
+        return 0;
+}
+
+/**
+ * Add request at end of queue of its class, class is derived from command.
+ *      Control request is queued as bulk while bulk write to the same device
+ *      is queued, so it is send after it.
+ *      With enabled setpoint shadow setpoint write replaces write of the
+ *      same setpoint queued as last one, so only newest value is send.
+ * @param sched Pointer to sdp_sched_t structure.
+ * @param req   Request with prepared command.
+ * @param shadow        Setpoint shadow of port used to count replaced
+ *      writes, NULL when writes must not be replaced.
+ * @return      Replaced request completed with "OK\r" response which
+ *      caller must pass to its callback, NULL when nothing was replaced.
+ */
+sdp_req_t *sdp_sched_push(sdp_sched_t *sched, sdp_req_t *req,
+                sdp_shadow_t *shadow)
+{
+        sdp_req_t *old, *prev;
+        sdp_class_t cls;
+
+        cls = sdp_cmd_class(req->cmd, req->cmd_len);
+        /* control request must not pass earlier write of preset or program
+         * it might depend on (RUNM after PROM), only safety requests do */
+        if (cls == sdp_class_control && sdp_sched_bulk_write(sched, req))
+                cls = sdp_class_bulk;
+        req->cls = cls;
+        req->queued = sdp_time_us();
+        req->next = NULL;
+
+        if (shadow && shadow->enabled &&
+                        (old = sdp_sched_find(sched, req, &prev))) {
+                req->next = old->next;
+                if (prev)
+                        prev->next = req;
+                else
+                        sched->head[cls] = req;
+                if (sched->tail[cls] == old)
+                        sched->tail[cls] = req;
+
+                old->next = NULL;
+                memcpy(old->resp, "OK\r", SDP_RESP_LEN_OK);
+                old->ret = SDP_RESP_LEN_OK;
+                old->err = 0;
+                shadow->coalesced++;
+                return old;
+        }
+
+        if (sched->tail[cls])
+                sched->tail[cls]->next = req;
+        else
+                sched->head[cls] = req;
+        sched->tail[cls] = req;
+
+        return NULL;
+}
+
+/**
+ * Take request of the highest priority class.
+ * @param sched Pointer to sdp_sched_t structure.
+ * @return      Request, NULL when queue is empty.
+ */
+sdp_req_t *sdp_sched_pop(sdp_sched_t *sched)
+{
+        sdp_sched_stats_t *stats;
+        sdp_req_t *req;
+        long long delay;
+        int cls;
+
+        for (cls = 0; cls < sdp_class_count; cls++) {
+                if (sched->head[cls])
+                        break;
+        }
+        if (cls == sdp_class_count)
+                return NULL;
+
+        req = sched->head[cls];
+        sched->head[cls] = req->next;
+        if (!sched->head[cls])
+                sched->tail[cls] = NULL;
+        req->next = NULL;
+
+        /* statistics might be read by other thread */
+        stats = &sched->stats[cls];
+        delay = sdp_time_us() - req->queued;
+        __atomic_store_n(&stats->count, stats->count + 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&stats->delay_sum, stats->delay_sum + delay,
+                        __ATOMIC_RELAXED);
+        if (delay > stats->delay_max)
+                __atomic_store_n(&stats->delay_max, delay, __ATOMIC_RELAXED);
+
+        return req;
+}
+
+/**
+ * Get queueing statistics of all classes, might be called from any thread.
+ * @param sched Pointer to sdp_sched_t structure.
+ * @param stats Array indexed by sdp_class_t used to store statistics.
+ */
+void sdp_sched_get_stats(sdp_sched_t *sched,
+                sdp_sched_stats_t stats[sdp_class_count])
+{
+        int cls;
+
+        for (cls = 0; cls < sdp_class_count; cls++) {
+                stats[cls].count = __atomic_load_n(&sched->stats[cls].count,
+                                __ATOMIC_RELAXED);
+                stats[cls].delay_sum = __atomic_load_n(
+                                &sched->stats[cls].delay_sum,
+                                __ATOMIC_RELAXED);
+                stats[cls].delay_max = __atomic_load_n(
+                                &sched->stats[cls].delay_max,
+                                __ATOMIC_RELAXED);
+        }
+}
+
+#endif
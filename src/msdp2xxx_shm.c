@@ -0,0 +1,487 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_shm.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Lock slot for writing, writers of different processes are serialized.
+ *      Lock held by process which died while writing is taken over.
+ * @param slot  Slot to lock.
+ * @param next  Used to store sequence number for sdp_shm_unlock.
+ * @return      0 on success, negative number (error no.) when slot was
+ *      locked by another writer for SDP_SHM_RETRY attempts (EAGAIN).
+ */
+static int sdp_shm_lock(sdp_shm_slot_t *slot, uint32_t *next)
+{
+        uint32_t seq;
+        pid_t writer;
+        int retry;
+
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        for (retry = 0; ; retry++) {
+                if (!(seq & 1)) {
+                        if (__atomic_compare_exchange_n(&slot->seq, &seq,
+                                                seq + 1, 1, __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED)) {
+                                seq++;
+                                break;
+                        }
+                        continue;
+                }
+                if (retry >= SDP_SHM_RETRY) {
+                        writer = __atomic_load_n(&slot->writer,
+                                        __ATOMIC_RELAXED);
+                        /* seq stays odd, only one writer takes over */
+                        if (writer && kill(writer, 0) < 0 &&
+                                        errno == ESRCH &&
+                                        __atomic_compare_exchange_n(
+                                                &slot->seq, &seq, seq + 2, 0,
+                                                __ATOMIC_ACQUIRE,
+                                                __ATOMIC_RELAXED)) {
+                                seq += 2;
+                                break;
+                        }
+                        errno = EAGAIN;
+                        return SDP_EERRNO;
+                }
+                sched_yield();
+                seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&slot->writer, getpid(), __ATOMIC_RELAXED);
+        /* data must not be writen before seq is odd */
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        *next = seq + 1;
+
+        return 0;
+}
+
+/**
+ * Finish writing of slot.
+ * @param slot  Slot locked by sdp_shm_lock.
+ * @param seq   Return value of sdp_shm_lock.
+ */
+static void sdp_shm_unlock(sdp_shm_slot_t *slot, uint32_t seq)
+{
+        __atomic_store_n(&slot->seq, seq, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get consistent copy of slot.
+ * @param slot  Slot to read.
+ * @param copy  Used to store copy.
+ * @return      0 on success, negative number (error no.) when writer did
+ *      not finish in SDP_SHM_RETRY attempts.
+ */
+static int sdp_shm_copy(const sdp_shm_slot_t *slot, sdp_shm_slot_t *copy)
+{
+        uint32_t seq;
+        int retry;
+
+        for (retry = 0; retry < SDP_SHM_RETRY; retry++) {
+                seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+                if (seq & 1)
+                        continue;
+                memcpy(copy, slot, sizeof(*copy));
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq)
+                        return 0;
+        }
+
+        errno = EAGAIN;
+        return SDP_EERRNO;
+}
+
+/**
+ * Map shared memory segment.
+ * @param shm   Pointer to sdp_shm_t structure.
+ * @param fd    Shared memory object.
+ * @param size  Size of segment.
+ * @param prot  Protection of mapping.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_shm_map(sdp_shm_t *shm, int fd, size_t size, int prot)
+{
+        void *ptr;
+
+        ptr = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+                return SDP_EERRNO;
+
+        shm->hdr = ptr;
+        shm->slot = (sdp_shm_slot_t *)(shm->hdr + 1);
+        shm->size = size;
+
+        return 0;
+}
+
+/**
+ * Check owner of segment, segment created by another user might contain
+ *      fake readings.
+ * @param st    Status of segment.
+ * @return      0 on success, negative number (error no.) when segment is
+ *      not owned by effective user or root.
+ */
+static int sdp_shm_check_owner(const struct stat *st)
+{
+        if (st->st_uid != geteuid() && st->st_uid != 0) {
+                errno = EACCES;
+                return SDP_EERRNO;
+        }
+
+        return 0;
+}
+
+/**
+ * Create shared memory segment, or open existing one of the same size, for
+ *      publishing of device state.
+ * @param shm   Pointer to uninitialized sdp_shm_t structure.
+ * @param name  Name of segment, NULL for SDP_SHM_NAME.
+ * @param slots Number of device slots.
+ * @param mode  Permissions of created segment, 0600 for readers of the
+ *      same user, 0644 to allow other users to read.
+ * @return      0 on success, negative number (error no.) on error, EACCES
+ *      when segment exists and is owned by another user.
+ */
+int sdp_shm_create(sdp_shm_t *shm, const char *name, int slots, int mode)
+{
+        size_t size;
+        struct stat st;
+        int fd, ret, e;
+
+        if (slots <= 0) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        if (!name)
+                name = SDP_SHM_NAME;
+
+        size = sizeof(sdp_shm_hdr_t) + slots * sizeof(sdp_shm_slot_t);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, mode);
+        if (fd < 0)
+                return SDP_EERRNO;
+        if (fstat(fd, &st) < 0)
+                goto err;
+        if ( (ret = sdp_shm_check_owner(&st)) < 0)
+                goto err;
+        if (st.st_size && st.st_size != (off_t)size) {
+                errno = EEXIST;
+                goto err;
+        }
+        /* new segment is filled by zeros, all slots are free */
+        if (!st.st_size && ftruncate(fd, size) < 0)
+                goto err;
+        if ( (ret = sdp_shm_map(shm, fd, size, PROT_READ | PROT_WRITE)) < 0)
+                goto err;
+        close(fd);
+
+        shm->hdr->slot_size = sizeof(sdp_shm_slot_t);
+        shm->hdr->slots = slots;
+        __atomic_store_n(&shm->hdr->magic, SDP_SHM_MAGIC, __ATOMIC_RELEASE);
+
+        return 0;
+
+err:
+        e = errno;
+        close(fd);
+        errno = e;
+        return SDP_EERRNO;
+}
+
+/**
+ * Open shared memory segment for reading.
+ * @param shm   Pointer to uninitialized sdp_shm_t structure.
+ * @param name  Name of segment, NULL for SDP_SHM_NAME.
+ * @return      0 on success, negative number (error no.) on error,
+ *      ENOENT when no publisher created segment, EACCES when segment is not
+ *      owned by effective user or root.
+ */
+int sdp_shm_open(sdp_shm_t *shm, const char *name)
+{
+        struct stat st;
+        int fd, ret, e;
+
+        if (!name)
+                name = SDP_SHM_NAME;
+
+        fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0)
+                return SDP_EERRNO;
+        if (fstat(fd, &st) < 0)
+                goto err;
+        if ( (ret = sdp_shm_check_owner(&st)) < 0)
+                goto err;
+        if (st.st_size < (off_t)sizeof(sdp_shm_hdr_t)) {
+                errno = ENOENT;
+                goto err;
+        }
+        if ( (ret = sdp_shm_map(shm, fd, st.st_size, PROT_READ)) < 0)
+                goto err;
+        close(fd);
+
+        if (__atomic_load_n(&shm->hdr->magic, __ATOMIC_ACQUIRE) !=
+                        SDP_SHM_MAGIC ||
+                        shm->hdr->slot_size != sizeof(sdp_shm_slot_t) ||
+                        sizeof(sdp_shm_hdr_t) + shm->hdr->slots *
+                        sizeof(sdp_shm_slot_t) > shm->size) {
+                sdp_shm_close(shm);
+                errno = EPROTO;
+                return SDP_EERRNO;
+        }
+
+        return 0;
+
+err:
+        e = errno;
+        close(fd);
+        errno = e;
+        return SDP_EERRNO;
+}
+
+/**
+ * Unmap shared memory segment, segment stays available for other processes.
+ * @param shm   Pointer to sdp_shm_t structure.
+ */
+void sdp_shm_close(sdp_shm_t *shm)
+{
+        if (shm->hdr)
+                munmap(shm->hdr, shm->size);
+        shm->hdr = NULL;
+        shm->slot = NULL;
+        shm->size = 0;
+}
+
+/**
+ * Find slot of device.
+ * @param shm   Pointer to sdp_shm_t structure.
+ * @param port  Serial port device is connected to.
+ * @param addr  RS485 address of device.
+ * @return      Slot index, or negative number (error no.) when device
+ *      was not published yet.
+ */
+int sdp_shm_find(sdp_shm_t *shm, const char *port, int addr)
+{
+        sdp_shm_slot_t copy;
+        unsigned int idx;
+
+        for (idx = 0; idx < shm->hdr->slots; idx++) {
+                if (__atomic_load_n(&shm->slot[idx].addr, __ATOMIC_ACQUIRE) !=
+                                addr)
+                        continue;
+                if (sdp_shm_copy(&shm->slot[idx], &copy) < 0)
+                        continue;
+                if (copy.addr == addr && !strncmp(copy.port, port,
+                                        sizeof(copy.port)))
+                        return idx;
+        }
+
+        errno = ENOENT;
+        return SDP_EERRNO;
+}
+
+/**
+ * Find slot of device, free slot is assigned to device when it is not
+ *      published yet.
+ * @param shm   Pointer to sdp_shm_t structure, created by sdp_shm_create.
+ * @param port  Serial port device is connected to.
+ * @param addr  RS485 address of device.
+ * @return      Slot index, or negative number (error no.) on error.
+ */
+int sdp_shm_slot(sdp_shm_t *shm, const char *port, int addr)
+{
+        unsigned int idx;
+        uint32_t seq;
+        int ret;
+
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX ||
+                        strlen(port) >= SDP_SHM_PORT_MAX) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        for (;;) {
+                if ( (ret = sdp_shm_find(shm, port, addr)) >= 0)
+                        return ret;
+
+                for (idx = 0; idx < shm->hdr->slots; idx++) {
+                        sdp_shm_slot_t *slot = &shm->slot[idx];
+
+                        if (__atomic_load_n(&slot->addr, __ATOMIC_RELAXED))
+                                continue;
+                        if ( (ret = sdp_shm_lock(slot, &seq)) < 0)
+                                return ret;
+                        /* slot might be taken by another publisher */
+                        if (slot->addr) {
+                                sdp_shm_unlock(slot, seq);
+                                break;
+                        }
+                        memset(&slot->data, 0, sizeof(slot->data));
+                        strcpy(slot->port, port);
+                        __atomic_store_n(&slot->addr, addr, __ATOMIC_RELEASE);
+                        sdp_shm_unlock(slot, seq);
+                        return idx;
+                }
+                if (idx == shm->hdr->slots) {
+                        errno = ENOSPC;
+                        return SDP_EERRNO;
+                }
+        }
+}
+
+/**
+ * Publish state of device.
+ * @param shm   Pointer to sdp_shm_t structure, created by sdp_shm_create.
+ * @param slot  Slot of device, see sdp_shm_slot.
+ * @param data  New state, time of publication is set by this function.
+ * @param parts Bitmask of SDP_SHM_* parts of data to publish.
+ * @return      0 on success, negative number (error no.) on error, EAGAIN
+ *      when slot is locked by another publisher for too long.
+ */
+int sdp_shm_publish(sdp_shm_t *shm, int slot, const sdp_shm_data_t *data,
+                unsigned int parts)
+{
+        sdp_shm_data_t *dst;
+        long long now;
+        uint32_t seq;
+        int ret;
+
+        if (slot < 0 || slot >= (int)shm->hdr->slots) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+
+        dst = &shm->slot[slot].data;
+        now = sdp_time_us();
+        if ( (ret = sdp_shm_lock(&shm->slot[slot], &seq)) < 0)
+                return ret;
+        if (parts & SDP_SHM_VA_DATA) {
+                dst->va_data = data->va_data;
+                dst->va_data_time = now;
+        }
+        if (parts & SDP_SHM_SETPOINT) {
+                dst->setpoint = data->setpoint;
+                dst->setpoint_time = now;
+        }
+        if (parts & SDP_SHM_LCD_INFO) {
+                dst->lcd_info = data->lcd_info;
+                dst->lcd_info_time = now;
+        }
+        dst->valid |= parts;
+        sdp_shm_unlock(&shm->slot[slot], seq);
+
+        return 0;
+}
+
+/**
+ * Read latest published state of device, never blocks.
+ * @param shm   Pointer to sdp_shm_t structure.
+ * @param slot  Slot of device, see sdp_shm_find.
+ * @param data  Used to store state, data->valid tells which parts were
+ *      published.
+ * @return      0 on success, negative number (error no.) on error, EAGAIN
+ *      when slot is just being writen for too long.
+ */
+int sdp_shm_read(sdp_shm_t *shm, int slot, sdp_shm_data_t *data)
+{
+        sdp_shm_slot_t copy;
+        int ret;
+
+        if (slot < 0 || slot >= (int)shm->hdr->slots) {
+                errno = EINVAL;
+                return SDP_EERRNO;
+        }
+        if ( (ret = sdp_shm_copy(&shm->slot[slot], &copy)) < 0)
+                return ret;
+        *data = copy.data;
+
+        return 0;
+}
+
+/**
+ * Publish results of sdp_get_va_data, sdp_get_va_setpoint and
+ *      sdp_get_lcd_info called on sdp, no extra commands are send to device.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @param shm   Pointer to sdp_shm_t structure, created by sdp_shm_create,
+ *      NULL to stop publishing.
+ * @param port  Serial port device is connected to, identifies device for
+ *      readers together with sdp->addr.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_shm_attach(sdp_t *sdp, sdp_shm_t *shm, const char *port)
+{
+        int ret;
+
+        if (!shm) {
+                sdp->shm = NULL;
+                return 0;
+        }
+        if ( (ret = sdp_shm_slot(shm, port, sdp->addr)) < 0)
+                return ret;
+
+        sdp->shm_slot = ret;
+        sdp->shm = shm;
+
+        return 0;
+}
+
+/**
+ * Publish part of device state read by sdp, used by sdp_get_* functions.
+ * @param sdp   Pointer to sdp_t structure attached by sdp_shm_attach.
+ * @param part  One of SDP_SHM_* parts.
+ * @param value Pointer to sdp_va_data_t, sdp_va_t or sdp_lcd_info_t,
+ *      depend on part.
+ */
+void sdp_shm_put(sdp_t *sdp, unsigned int part, const void *value)
+{
+        sdp_shm_slot_t *slot = &sdp->shm->slot[sdp->shm_slot];
+        uint32_t seq;
+        long long now;
+
+        now = sdp_time_us();
+        /* state is published again by next read */
+        if (sdp_shm_lock(slot, &seq) < 0)
+                return;
+        switch (part) {
+        case SDP_SHM_VA_DATA:
+                slot->data.va_data = *(const sdp_va_data_t *)value;
+                slot->data.va_data_time = now;
+                break;
+        case SDP_SHM_SETPOINT:
+                slot->data.setpoint = *(const sdp_va_t *)value;
+                slot->data.setpoint_time = now;
+                break;
+        case SDP_SHM_LCD_INFO:
+                slot->data.lcd_info = *(const sdp_lcd_info_t *)value;
+                slot->data.lcd_info_time = now;
+                break;
+        }
+        slot->data.valid |= part;
+        sdp_shm_unlock(slot, seq);
+}
+
+#endif
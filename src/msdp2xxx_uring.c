@@ -0,0 +1,747 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+#include "msdp2xxx_uring.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* kind of operation, stored in lower bits of user_data */
+#define SDP_URING_WRITE         (0)
+#define SDP_URING_READ          (1)
+#define SDP_URING_TIMEOUT       (2)
+#define SDP_URING_KIND_BITS     (2)
+
+/**
+ * Port attached to io_uring and state of its exchange.
+ */
+struct sdp_uring_slot {
+        /** attached device, NULL when slot is free */
+        sdp_t *sdp;
+        /** buffer used to store response */
+        char *buf;
+        /** lenght of expected response */
+        int count;
+        /** 1 when count is exact lenght of response */
+        int exact;
+        /** time when waiting for response expire [us] */
+        long long deadline;
+        /** lenght of command in registered buffer */
+        int wlen;
+        /** prepared write of command, linked with following read */
+        struct io_uring_sqe *wsqe;
+        /** position of wsqe in submission queue */
+        unsigned int wtail;
+        /** number of submitted operations not completed yet */
+        int inflight;
+        /** 1 while read is submitted */
+        int reading;
+        /** 1 while exchange is in progress */
+        int busy;
+        /** result of exchange, 0 while not known */
+        int ret;
+        /** errno when exchange failed */
+        int err;
+        /** time when result of exchange became known [us] */
+        long long done;
+        /** timeout of read, must live until it is submitted */
+        struct __kernel_timespec ts;
+};
+
+/**
+ * Get command buffer of slot.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param idx   Slot index.
+ * @return      Registered buffer of size SDP_URING_TX_SIZE.
+ */
+static char *sdp_uring_tx(sdp_uring_t *ur, int idx)
+{
+        return ur->bufs + idx * (SDP_URING_TX_SIZE + SDP_RX_BUF_SIZE);
+}
+
+/**
+ * Get response buffer of slot.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param idx   Slot index.
+ * @return      Registered buffer of size SDP_RX_BUF_SIZE.
+ */
+static char *sdp_uring_rx(sdp_uring_t *ur, int idx)
+{
+        return sdp_uring_tx(ur, idx) + SDP_URING_TX_SIZE;
+}
+
+/**
+ * Get free submission queue entry.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @return      Zeroed entry, NULL when submission queue is full.
+ */
+static struct io_uring_sqe *sdp_uring_sqe(sdp_uring_t *ur)
+{
+        struct io_uring_sqe *sqe;
+        unsigned int tail, idx;
+
+        tail = *ur->sq_tail + ur->to_submit;
+        if (tail - __atomic_load_n(ur->sq_head, __ATOMIC_ACQUIRE) >
+                        *ur->sq_mask)
+                return NULL;
+
+        idx = tail & *ur->sq_mask;
+        sqe = (struct io_uring_sqe *)ur->sqes + idx;
+        memset(sqe, 0, sizeof(*sqe));
+        ur->sq_array[idx] = idx;
+        ur->to_submit++;
+
+        return sqe;
+}
+
+/**
+ * Submit prepared entries and wait for completions.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param wait  Minimal number of completions to wait for.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+static int sdp_uring_enter(sdp_uring_t *ur, int wait)
+{
+        int idx, ret;
+
+        __atomic_store_n(ur->sq_tail, *ur->sq_tail + ur->to_submit,
+                        __ATOMIC_RELEASE);
+
+        ur->enters++;
+        for (idx = 0; idx < ur->slots; idx++) {
+                sdp_t *sdp = ur->slot[idx].sdp;
+
+                if (sdp && ur->slot[idx].busy) {
+                        sdp->io.syscalls++;
+                        sdp->io.wakeups++;
+                }
+        }
+
+        ret = syscall(__NR_io_uring_enter, ur->fd, ur->to_submit, wait,
+                        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret < 0) {
+                if (errno == EINTR)
+                        return 0;
+                return SDP_EERRNO;
+        }
+        ur->to_submit -= ret;
+        for (idx = 0; idx < ur->slots; idx++)
+                ur->slot[idx].wsqe = NULL;
+
+        return 0;
+}
+
+/**
+ * Finish exchange of slot with error.
+ * @param slot  Slot with exchange in progress.
+ * @param ret   Negative number (error no.).
+ * @param err   Value of errno.
+ */
+static void sdp_uring_fail(sdp_uring_slot_t *slot, int ret, int err)
+{
+        if (slot->ret)
+                return;
+        slot->ret = ret;
+        slot->err = err;
+        slot->done = sdp_time_us();
+}
+
+/**
+ * Submit read of missing part of response, linked with timeout.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param idx   Slot index.
+ */
+static void sdp_uring_arm(sdp_uring_t *ur, int idx)
+{
+        sdp_uring_slot_t *slot = &ur->slot[idx];
+        sdp_t *sdp = slot->sdp;
+        struct io_uring_sqe *sqe, *sqe_ts;
+        long long timeout;
+        char *rx_buf;
+        unsigned int tail;
+        int ret, space;
+
+        ret = sdp_rx_resp(&sdp->rx, slot->buf, slot->count, slot->exact);
+        if (ret) {
+                if (ret > 0)
+                        sdp->io.frames++;
+                slot->ret = ret;
+                slot->err = (ret < 0) ? errno : 0;
+                slot->done = sdp_time_us();
+                return;
+        }
+
+        timeout = slot->deadline - sdp_time_us();
+        if (timeout <= 0) {
+                sdp_rx_expire(&sdp->rx);
+                sdp_uring_fail(slot, SDP_ETIMEDOUT, ETIMEDOUT);
+                return;
+        }
+
+        space = sdp_rx_space(&sdp->rx, &rx_buf);
+        if (!space) {
+                sdp_rx_init(&sdp->rx);
+                sdp_uring_fail(slot, SDP_ETOLARGE, ERANGE);
+                return;
+        }
+        /* do not read beyond end of response */
+        if (space > slot->count - sdp->rx.len)
+                space = slot->count - sdp->rx.len;
+
+        tail = *ur->sq_tail + ur->to_submit;
+        sqe = sdp_uring_sqe(ur);
+        sqe_ts = sqe ? sdp_uring_sqe(ur) : NULL;
+        if (!sqe_ts) {
+                if (sqe)
+                        ur->to_submit--;
+                /* submission queue is full, try again after enter */
+                return;
+        }
+
+        /* read is submitted only when command was writen, it must
+         * directly follow the write to be linked with it */
+        if (slot->wsqe && slot->wtail + 1 == tail)
+                slot->wsqe->flags |= IOSQE_IO_LINK;
+        slot->wsqe = NULL;
+
+        sqe->opcode = IORING_OP_READ_FIXED;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->fd = sdp->f_in;
+        sqe->off = -1;
+        sqe->addr = (unsigned long)sdp_uring_rx(ur, idx);
+        sqe->len = space;
+        sqe->buf_index = idx * 2 + 1;
+        sqe->user_data = (idx << SDP_URING_KIND_BITS) | SDP_URING_READ;
+
+        slot->ts.tv_sec = timeout / 1000000ll;
+        slot->ts.tv_nsec = (timeout % 1000000ll) * 1000;
+        sqe_ts->opcode = IORING_OP_LINK_TIMEOUT;
+        sqe_ts->addr = (unsigned long)&slot->ts;
+        sqe_ts->len = 1;
+        sqe_ts->user_data = (idx << SDP_URING_KIND_BITS) | SDP_URING_TIMEOUT;
+
+        slot->inflight += 2;
+        slot->reading = 1;
+}
+
+/**
+ * Process completion.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param cqe   Completion queue entry.
+ */
+static void sdp_uring_cqe(sdp_uring_t *ur, struct io_uring_cqe *cqe)
+{
+        int idx = cqe->user_data >> SDP_URING_KIND_BITS;
+        sdp_uring_slot_t *slot = &ur->slot[idx];
+        sdp_t *sdp = slot->sdp;
+        char *rx_buf;
+
+        slot->inflight--;
+        switch (cqe->user_data & ((1 << SDP_URING_KIND_BITS) - 1)) {
+        case SDP_URING_WRITE:
+                if (cqe->res < 0)
+                        sdp_uring_fail(slot, SDP_EERRNO, -cqe->res);
+                else if (cqe->res != slot->wlen)
+                        sdp_uring_fail(slot, SDP_EWINCOMPL, EIO);
+                break;
+        case SDP_URING_READ:
+                slot->reading = 0;
+                if (slot->ret)
+                        break;
+                if (cqe->res > 0) {
+                        sdp_rx_space(&sdp->rx, &rx_buf);
+                        memcpy(rx_buf, sdp_uring_rx(ur, idx), cqe->res);
+                        sdp_rx_commit(&sdp->rx, cqe->res);
+                } else if (cqe->res == 0) {
+                        sdp_rx_init(&sdp->rx);
+                        sdp_uring_fail(slot, SDP_EERRNO, EIO);
+                } else if (cqe->res != -EAGAIN && cqe->res != -EINTR &&
+                                cqe->res != -ECANCELED) {
+                        sdp_rx_init(&sdp->rx);
+                        sdp_uring_fail(slot, SDP_EERRNO, -cqe->res);
+                }
+                /* canceled by timeout, deadline is checked by next arm */
+                break;
+        default:
+                break;
+        }
+}
+
+/**
+ * Drive exchanges of all busy slots until they are completed. Each
+ *      io_uring_enter waits for all submitted operations but reads of other
+ *      ports, so exchange which recieves whole response by one read costs
+ *      single system call and completion time of each port is known.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @return      0 on success, negative number (error no.) when io_uring
+ *      failed, exchanges in progress fail with the same error.
+ */
+static int sdp_uring_run(sdp_uring_t *ur)
+{
+        int idx, ret, reads, wait;
+
+        while (ur->busy) {
+                unsigned int head, tail;
+
+                reads = 0;
+                wait = 0;
+                for (idx = 0; idx < ur->slots; idx++) {
+                        sdp_uring_slot_t *slot = &ur->slot[idx];
+
+                        if (!slot->busy)
+                                continue;
+                        if (!slot->ret && !slot->reading)
+                                sdp_uring_arm(ur, idx);
+                        if (slot->inflight) {
+                                wait += slot->inflight;
+                                reads += slot->reading;
+                                continue;
+                        }
+                        if (slot->ret) {
+                                slot->busy = 0;
+                                ur->busy--;
+                        }
+                }
+                if (!wait && !ur->to_submit)
+                        continue;
+                /* with several ports wait only until first read and its
+                 * timeout complete, so time of response is known for each
+                 * port */
+                if (reads > 1)
+                        wait -= (reads - 1) * 2;
+
+                if ( (ret = sdp_uring_enter(ur, wait)) < 0) {
+                        int err = errno;
+
+                        for (idx = 0; idx < ur->slots; idx++) {
+                                if (!ur->slot[idx].busy)
+                                        continue;
+                                sdp_uring_fail(&ur->slot[idx], ret, err);
+                                ur->slot[idx].busy = 0;
+                        }
+                        ur->busy = 0;
+                        errno = err;
+                        return ret;
+                }
+
+                head = *ur->cq_head;
+                tail = __atomic_load_n(ur->cq_tail, __ATOMIC_ACQUIRE);
+                for (; head != tail; head++)
+                        sdp_uring_cqe(ur, (struct io_uring_cqe *)ur->cqes +
+                                        (head & *ur->cq_mask));
+                __atomic_store_n(ur->cq_head, head, __ATOMIC_RELEASE);
+        }
+
+        return 0;
+}
+
+/**
+ * Initialize io_uring for several ports.
+ * @param ur    Pointer to uninitialized sdp_uring_t structure.
+ * @param ports Maximal number of attached ports.
+ * @return      0 on success, negative number (error no.) on error,
+ *      ENOSYS when kernel does not support io_uring.
+ */
+int sdp_uring_init(sdp_uring_t *ur, int ports)
+{
+        struct io_uring_params p;
+        struct iovec *iov;
+        int idx, e;
+
+        memset(ur, 0, sizeof(*ur));
+        ur->fd = -1;
+        ur->slots = ports;
+
+        memset(&p, 0, sizeof(p));
+        /* write, read and timeout of each port */
+        ur->fd = syscall(__NR_io_uring_setup, ports * 4, &p);
+        if (ur->fd < 0)
+                return SDP_EERRNO;
+
+        ur->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        ur->cq_ring_size = p.cq_off.cqes +
+                p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                if (ur->cq_ring_size > ur->sq_ring_size)
+                        ur->sq_ring_size = ur->cq_ring_size;
+                ur->cq_ring_size = ur->sq_ring_size;
+        }
+        ur->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+        ur->sq_ring = mmap(NULL, ur->sq_ring_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQ_RING);
+        if (ur->sq_ring == MAP_FAILED)
+                goto err;
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                ur->cq_ring = ur->sq_ring;
+        } else {
+                ur->cq_ring = mmap(NULL, ur->cq_ring_size,
+                                PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ur->fd,
+                                IORING_OFF_CQ_RING);
+                if (ur->cq_ring == MAP_FAILED)
+                        goto err;
+        }
+        ur->sqes = mmap(NULL, ur->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ur->fd, IORING_OFF_SQES);
+        if (ur->sqes == MAP_FAILED)
+                goto err;
+
+        ur->sq_head = (unsigned *)((char *)ur->sq_ring + p.sq_off.head);
+        ur->sq_tail = (unsigned *)((char *)ur->sq_ring + p.sq_off.tail);
+        ur->sq_mask = (unsigned *)((char *)ur->sq_ring + p.sq_off.ring_mask);
+        ur->sq_array = (unsigned *)((char *)ur->sq_ring + p.sq_off.array);
+        ur->cq_head = (unsigned *)((char *)ur->cq_ring + p.cq_off.head);
+        ur->cq_tail = (unsigned *)((char *)ur->cq_ring + p.cq_off.tail);
+        ur->cq_mask = (unsigned *)((char *)ur->cq_ring + p.cq_off.ring_mask);
+        ur->cqes = (char *)ur->cq_ring + p.cq_off.cqes;
+
+        ur->slot = calloc(ports, sizeof(*ur->slot));
+        ur->bufs = malloc(ports * (SDP_URING_TX_SIZE + SDP_RX_BUF_SIZE));
+        iov = malloc(ports * 2 * sizeof(*iov));
+        if (!ur->slot || !ur->bufs || !iov) {
+                free(iov);
+                goto err;
+        }
+        for (idx = 0; idx < ports; idx++) {
+                iov[idx * 2].iov_base = sdp_uring_tx(ur, idx);
+                iov[idx * 2].iov_len = SDP_URING_TX_SIZE;
+                iov[idx * 2 + 1].iov_base = sdp_uring_rx(ur, idx);
+                iov[idx * 2 + 1].iov_len = SDP_RX_BUF_SIZE;
+        }
+        if (syscall(__NR_io_uring_register, ur->fd, IORING_REGISTER_BUFFERS,
+                                iov, ports * 2) < 0) {
+                free(iov);
+                goto err;
+        }
+        free(iov);
+
+        return 0;
+
+err:
+        e = errno;
+        sdp_uring_close(ur);
+        errno = e;
+        return SDP_EERRNO;
+}
+
+/**
+ * Release io_uring, all attached ports must be removed first.
+ * @param ur    Pointer to sdp_uring_t structure, initialized by
+ *      sdp_uring_init.
+ */
+void sdp_uring_close(sdp_uring_t *ur)
+{
+        if (ur->sqes && ur->sqes != MAP_FAILED)
+                munmap(ur->sqes, ur->sqes_size);
+        if (ur->cq_ring && ur->cq_ring != MAP_FAILED &&
+                        ur->cq_ring != ur->sq_ring)
+                munmap(ur->cq_ring, ur->cq_ring_size);
+        if (ur->sq_ring && ur->sq_ring != MAP_FAILED)
+                munmap(ur->sq_ring, ur->sq_ring_size);
+        if (ur->fd >= 0)
+                close(ur->fd);
+        free(ur->slot);
+        free(ur->bufs);
+        memset(ur, 0, sizeof(*ur));
+        ur->fd = -1;
+}
+
+/**
+ * Attach port to io_uring, sdp_write and sdp_read_resp of sdp then use it.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param sdp   Pointer to sdp_t structure, initialized by sdp_open.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_uring_add(sdp_uring_t *ur, sdp_t *sdp)
+{
+        int idx;
+
+        if (sdp->uring) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+
+        for (idx = 0; idx < ur->slots; idx++) {
+                if (ur->slot[idx].sdp)
+                        continue;
+                memset(&ur->slot[idx], 0, sizeof(ur->slot[idx]));
+                ur->slot[idx].sdp = sdp;
+                sdp->uring = ur;
+                sdp->uring_slot = idx;
+                return 0;
+        }
+
+        errno = ENOSPC;
+        return SDP_EERRNO;
+}
+
+/**
+ * Detach port from io_uring, port uses poll/select again.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param sdp   Pointer to sdp_t structure, attached by sdp_uring_add.
+ * @return      0 on success, negative number (error no.) on error.
+ */
+int sdp_uring_del(sdp_uring_t *ur, sdp_t *sdp)
+{
+        if (sdp->uring != ur) {
+                errno = ENOENT;
+                return SDP_EERRNO;
+        }
+
+        ur->slot[sdp->uring_slot].sdp = NULL;
+        sdp->uring = NULL;
+
+        return 0;
+}
+
+/**
+ * Prepare write of command, it is submitted together with read of response
+ *      by sdp_uring_read_resp or sdp_uring_xfer.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param idx   Slot index.
+ * @param buf   Command.
+ * @param count Lenght of command.
+ * @return      count on success, negative number (error no.) on error.
+ */
+static int sdp_uring_prep_write(sdp_uring_t *ur, int idx, const char *buf,
+                int count)
+{
+        sdp_uring_slot_t *slot = &ur->slot[idx];
+        struct io_uring_sqe *sqe;
+
+        if (count > SDP_URING_TX_SIZE) {
+                errno = ERANGE;
+                return SDP_ETOLARGE;
+        }
+        if (slot->inflight) {
+                errno = EBUSY;
+                return SDP_EERRNO;
+        }
+        sqe = sdp_uring_sqe(ur);
+        if (!sqe) {
+                errno = EAGAIN;
+                return SDP_EERRNO;
+        }
+
+        memcpy(sdp_uring_tx(ur, idx), buf, count);
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = slot->sdp->f_out;
+        sqe->off = -1;
+        sqe->addr = (unsigned long)sdp_uring_tx(ur, idx);
+        sqe->len = count;
+        sqe->buf_index = idx * 2;
+        sqe->user_data = (idx << SDP_URING_KIND_BITS) | SDP_URING_WRITE;
+
+        slot->wlen = count;
+        slot->wsqe = sqe;
+        slot->wtail = *ur->sq_tail + ur->to_submit - 1;
+        slot->inflight++;
+
+        return count;
+}
+
+/**
+ * Start exchange on slot, response is recieved by sdp_uring_run.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param idx   Slot index.
+ * @param buf   Buffer used to store response.
+ * @param count Lenght of expected response.
+ * @param exact 1 when count is exact lenght of response.
+ * @param timeout_us    Time to wait for response [us].
+ */
+static void sdp_uring_start(sdp_uring_t *ur, int idx, char *buf, int count,
+                int exact, long timeout_us)
+{
+        sdp_uring_slot_t *slot = &ur->slot[idx];
+
+        slot->buf = buf;
+        slot->count = count;
+        slot->exact = exact;
+        slot->deadline = sdp_time_us() + timeout_us;
+        slot->ret = 0;
+        slot->err = 0;
+        slot->done = 0;
+        slot->busy = 1;
+        ur->busy++;
+}
+
+/**
+ * Write command to port attached to io_uring. Write is only prepared and
+ *      submitted by following sdp_uring_read_resp, linked with read of
+ *      response, so whole exchange costs single system call.
+ * @param sdp   Pointer to sdp_t structure, attached by sdp_uring_add.
+ * @param buf   Command.
+ * @param count Lenght of command.
+ * @return      count on success, negative number (error no.) on error.
+ */
+int sdp_uring_write(sdp_t *sdp, const char *buf, int count)
+{
+        return sdp_uring_prep_write(sdp->uring, sdp->uring_slot, buf, count);
+}
+
+/**
+ * Read response from port attached to io_uring, see sdp_read_resp.
+ * @param sdp   Pointer to sdp_t structure, attached by sdp_uring_add.
+ * @param buf   Buffer to store response.
+ * @param count Lenght of expected response.
+ * @param exact 1 when count is exact lenght of response.
+ * @param timeout_us    Time to wait for response [us].
+ * @return      Lenght of response, or negative number (error no.) on error.
+ */
+int sdp_uring_read_resp(sdp_t *sdp, char *buf, int count, int exact,
+                long timeout_us)
+{
+        sdp_uring_t *ur = sdp->uring;
+        sdp_uring_slot_t *slot = &ur->slot[sdp->uring_slot];
+        int ret;
+
+        sdp_uring_start(ur, sdp->uring_slot, buf, count, exact, timeout_us);
+        if ( (ret = sdp_uring_run(ur)) < 0)
+                return ret;
+
+        if (slot->ret < 0)
+                errno = slot->err;
+
+        return slot->ret;
+}
+
+/**
+ * Exchange requests with several ports at once, commands of all requests
+ *      are submitted by one system call and responses are collected as they
+ *      arrive. Each request must be for different port attached to ur,
+ *      req->sdp must be set. Setpoint shadow, cache and circuit breaker of
+ *      port are applied as to requests submitted by sdp_loop_submit.
+ * @param ur    Pointer to sdp_uring_t structure.
+ * @param reqs  Array of requests with prepared commands.
+ * @param count Number of requests.
+ * @return      0 on success, negative number (error no.) of first failed
+ *      request, results are stored in req->ret and req->err, callbacks
+ *      are called.
+ */
+int sdp_uring_xfer(sdp_uring_t *ur, sdp_req_t **reqs, int count)
+{
+        long long start;
+        int idx, ret = 0;
+
+        start = sdp_time_us();
+        for (idx = 0; idx < count; idx++) {
+                sdp_req_t *req = reqs[idx];
+                sdp_t *sdp = req->sdp;
+                sdp_op_t op;
+                int size, exact = 0;
+
+                req->ret = 0;
+                if (!sdp || sdp->uring != ur ||
+                                ur->slot[sdp->uring_slot].busy) {
+                        req->ret = SDP_EERRNO;
+                        req->err = EINVAL;
+                        continue;
+                }
+                req->ret = sdp_caps_check_cmd(sdp->caps, req->cmd,
+                                req->cmd_len);
+                if (req->ret < 0) {
+                        req->err = errno;
+                        continue;
+                }
+                /* device holds setpoint already */
+                if (sdp_shadow_check(sdp, req->cmd, req->cmd_len)) {
+                        memcpy(req->resp, "OK\r", SDP_RESP_LEN_OK);
+                        req->ret = SDP_RESP_LEN_OK;
+                        req->err = 0;
+                        continue;
+                }
+                req->ret = sdp_cache_get(sdp, req->cmd, req->cmd_len,
+                                req->resp, sizeof(req->resp));
+                if (req->ret > 0) {
+                        req->err = 0;
+                        continue;
+                }
+                if (sdp_cmd_class(req->cmd, req->cmd_len) <= sdp_class_control)
+                        __atomic_fetch_add(&sdp->changes, 1,
+                                        __ATOMIC_RELAXED);
+                /* device which does not respond is not waited for, after
+                 * backoff request itself probes device */
+                req->ret = sdp_breaker_allow(&sdp->breaker[sdp_cmd_addr(
+                                        req->cmd, req->cmd_len)]);
+                if (req->ret < 0) {
+                        req->err = errno;
+                        continue;
+                }
+
+                op = sdp_op_id(req->cmd, req->cmd_len);
+                size = sizeof(req->resp);
+                if (sdp_op_resp_len(op)) {
+                        size = sdp_op_resp_len(op);
+                        exact = 1;
+                }
+                req->ret = sdp_uring_prep_write(ur, sdp->uring_slot,
+                                req->cmd, req->cmd_len);
+                if (req->ret < 0) {
+                        req->err = errno;
+                        continue;
+                }
+                /* request is in flight, see below */
+                req->ret = 0;
+                sdp_uring_start(ur, sdp->uring_slot, req->resp, size, exact,
+                                sdp_resp_timeout(sdp, op, size));
+                sdp_uring_arm(ur, sdp->uring_slot);
+        }
+
+        sdp_uring_run(ur);
+
+        for (idx = 0; idx < count; idx++) {
+                sdp_req_t *req = reqs[idx];
+                sdp_uring_slot_t *slot;
+
+                if (req->ret == 0) {
+                        sdp_t *sdp = req->sdp;
+
+                        slot = &ur->slot[sdp->uring_slot];
+                        req->ret = slot->ret;
+                        req->err = slot->err;
+                        /* slow port does not inflate RTT of others */
+                        sdp_rtt_update(sdp, sdp_op_id(req->cmd,
+                                                req->cmd_len), req->ret,
+                                        slot->done - start);
+                        sdp_breaker_update(&sdp->breaker[sdp_cmd_addr(
+                                                req->cmd, req->cmd_len)],
+                                        req->ret);
+                        sdp_shadow_update(sdp, req->cmd, req->cmd_len,
+                                        req->ret);
+                        sdp_cache_update(sdp, req->cmd, req->cmd_len,
+                                        req->resp, req->ret);
+                }
+                if (req->ret < 0 && !ret)
+                        ret = req->ret;
+                if (req->cb)
+                        req->cb(req);
+        }
+
+        return ret;
+}
+
+#endif
@@ -0,0 +1,409 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+/*
+ * Compare methods used to wait for response from device. For each method
+ * the same command is send repeatedly and number of wakeups, system calls,
+ * CPU time and latency per recieved response is reported. With several
+ * ports the command is send to each of them in every round, io_uring
+ * exchanges whole round by sdp_uring_xfer. Option -s replaces devices by
+ * simulators connected over pseudo terminals.
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msdp2xxx.h"
+#include "msdp2xxx_low.h"
+
+#ifndef __linux__
+#error "Unsupported OS"
+#endif
+
+#include "msdp2xxx_uring.h"
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char *method_names[] = {
+        "select",
+        "poll",
+        "epoll",
+        "vmin",
+        "uring",
+};
+
+#define METHOD_COUNT (sizeof(method_names) / sizeof(*method_names))
+/* io_uring is not wait method, it follows them in method_names */
+#define METHOD_URING (4)
+
+/** Maximal number of tested ports. */
+#define PORTS_MAX (64)
+
+/**
+ * Get CPU time consumed by process.
+ * @return      User and system time [us].
+ */
+static long long cpu_time_us(void)
+{
+        struct rusage ru;
+
+        getrusage(RUSAGE_SELF, &ru);
+
+        return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ll +
+                ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/**
+ * Send request to all ports one by one.
+ * @param sdp   Opened ports.
+ * @param ports Number of ports.
+ * @return      Number of failed requests.
+ */
+static int round_seq(sdp_t *sdp, int ports)
+{
+        sdp_va_data_t va_data;
+        int errors = 0;
+        int i;
+
+        for (i = 0; i < ports; i++)
+                if (sdp_get_va_data(&sdp[i], &va_data) < 0)
+                        errors++;
+
+        return errors;
+}
+
+/**
+ * Send request to all ports at once by io_uring.
+ * @param ur    io_uring all ports are attached to.
+ * @param sdp   Opened ports.
+ * @param reqs  Requests, one for each port.
+ * @param ports Number of ports.
+ * @return      Number of failed requests.
+ */
+static int round_uring(sdp_uring_t *ur, sdp_t *sdp, sdp_req_t *reqs, int ports)
+{
+        sdp_req_t *preqs[PORTS_MAX];
+        sdp_va_data_t va_data;
+        int errors = 0;
+        int i;
+
+        for (i = 0; i < ports; i++) {
+                reqs[i].sdp = &sdp[i];
+                reqs[i].cmd_len = sdp_sget_va_data(reqs[i].cmd, sdp[i].addr);
+                preqs[i] = &reqs[i];
+        }
+        sdp_uring_xfer(ur, preqs, ports);
+        for (i = 0; i < ports; i++)
+                if (reqs[i].ret < 0 || sdp_resp_va_data(reqs[i].resp,
+                                        reqs[i].ret, &va_data) < 0)
+                        errors++;
+
+        return errors;
+}
+
+/**
+ * Run benchmark of one method and print results.
+ * @param fnames        Serial ports.
+ * @param ports Number of ports.
+ * @param addr  RS485 address of devices.
+ * @param method        Tested method, index into method_names.
+ * @param count Number of rounds.
+ * @return      0 on success, -1 on error.
+ */
+static int bench(char **fnames, int ports, int addr, int method, int count)
+{
+        static sdp_req_t reqs[PORTS_MAX];
+        static sdp_t sdp[PORTS_MAX];
+        sdp_open_opts_t opts;
+        long long start, cpu, lat, lat_min = -1, lat_max = 0, lat_sum = 0;
+        sdp_io_stats_t io;
+        sdp_uring_t ur;
+        int ur_ok = 0, uring = 0;
+        int errors = 0, rounds = 0;
+        int ret, i, n;
+
+        if (method == METHOD_URING)
+                ur_ok = (sdp_uring_init(&ur, ports) == 0);
+
+        for (i = 0; i < ports; i++) {
+                memset(&opts, 0, sizeof(opts));
+                opts.flags = SDP_OPEN_LOW_LATENCY | SDP_OPEN_FLUSH;
+                if (method == METHOD_URING) {
+                        opts.flags |= SDP_OPEN_URING;
+                        opts.uring = ur_ok ? &ur : NULL;
+                } else {
+                        opts.wait = method;
+                }
+                ret = sdp_open_ex(&sdp[i], fnames[i], addr, &opts);
+                if (ret < 0) {
+                        perror("sdp_open_ex failed");
+                        goto err;
+                }
+                uring = (opts.accepted & SDP_OPEN_URING) != 0;
+                ret = sdp_remote(&sdp[i], 1);
+                if (ret < 0) {
+                        perror("Failed to switch to remote mode");
+                        sdp_close(&sdp[i]);
+                        goto err;
+                }
+                memset(&sdp[i].io, 0, sizeof(sdp[i].io));
+        }
+        if (method == METHOD_URING && !uring)
+                fprintf(stderr, "io_uring not available, select used\n");
+
+        cpu = cpu_time_us();
+        for (n = 0; n < count; n++) {
+                start = sdp_time_us();
+                if (uring && ports > 1)
+                        ret = round_uring(&ur, sdp, reqs, ports);
+                else
+                        ret = round_seq(sdp, ports);
+                lat = sdp_time_us() - start;
+                errors += ret;
+                if (ret)
+                        continue;
+                rounds++;
+                lat_sum += lat;
+                if (lat_min < 0 || lat < lat_min)
+                        lat_min = lat;
+                if (lat > lat_max)
+                        lat_max = lat;
+        }
+        cpu = cpu_time_us() - cpu;
+
+        memset(&io, 0, sizeof(io));
+        for (i = 0; i < ports; i++) {
+                io.wakeups += sdp[i].io.wakeups;
+                io.syscalls += sdp[i].io.syscalls;
+                io.frames += sdp[i].io.frames;
+                sdp_remote(&sdp[i], 0);
+                sdp_close(&sdp[i]);
+        }
+        if (uring) {
+                /* one io_uring_enter serves all ports of round */
+                io.wakeups = io.syscalls = ur.enters;
+        }
+        if (ur_ok)
+                sdp_uring_close(&ur);
+
+        if (!io.frames || !rounds) {
+                printf("%-8s %6d %6d          no response recieved\n",
+                                method_names[method], count * ports, errors);
+                return 0;
+        }
+        printf("%-8s %6lu %6d %8.2f %8.2f %8lld %8lld %8lld %8lld\n",
+                        method_names[method], io.frames, errors,
+                        (double)io.wakeups / io.frames,
+                        (double)io.syscalls / io.frames,
+                        cpu / (long long)io.frames,
+                        lat_sum / rounds, lat_min, lat_max);
+
+        return 0;
+
+err:
+        while (i--) {
+                sdp_remote(&sdp[i], 0);
+                sdp_close(&sdp[i]);
+        }
+        if (ur_ok)
+                sdp_uring_close(&ur);
+        return -1;
+}
+
+/**
+ * Serve commands recieved on master side of pseudo terminal like device
+ *      which has all values zero. Never returns.
+ * @param fd    Master side of pseudo terminal.
+ */
+static void sim_run(int fd)
+{
+        char buf[SDP_RX_BUF_SIZE], resp[SDP_RX_BUF_SIZE];
+        int len = 0, ret, n;
+        char *end;
+
+        while ( (ret = read(fd, buf + len, sizeof(buf) - len)) > 0) {
+                len += ret;
+                while ( (end = memchr(buf, '\r', len))) {
+                        n = end - buf + 1;
+                        ret = sdp_resp_len(buf, n);
+                        /* values are zeros, followed by "\rOK\r" */
+                        if (ret > 3) {
+                                memset(resp, '0', ret - 4);
+                                resp[ret - 4] = '\r';
+                        } else {
+                                ret = 3;
+                        }
+                        memcpy(resp + ret - 3, "OK\r", 3);
+                        if (write(fd, resp, ret) < 0)
+                                _exit(1);
+                        len -= n;
+                        memmove(buf, buf + n, len);
+                }
+                if (len == sizeof(buf))
+                        len = 0;
+        }
+        _exit(0);
+}
+
+/**
+ * Start simulator of device on new pseudo terminal.
+ * @param pid   Used to store process id of simulator.
+ * @return      Name of slave side of pseudo terminal, NULL on error.
+ */
+static char *sim_start(pid_t *pid)
+{
+        char *name;
+        int fd;
+
+        fd = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd < 0)
+                return NULL;
+        if (grantpt(fd) < 0 || unlockpt(fd) < 0 || !(name = ptsname(fd))) {
+                close(fd);
+                return NULL;
+        }
+        name = strdup(name);
+        /* keep slave side open, master read fail when it is closed */
+        if (!name || open(name, O_RDWR | O_NOCTTY) < 0) {
+                free(name);
+                close(fd);
+                return NULL;
+        }
+
+        *pid = fork();
+        if (*pid == 0)
+                sim_run(fd);
+        close(fd);
+        if (*pid < 0) {
+                free(name);
+                return NULL;
+        }
+
+        return name;
+}
+
+static void usage(const char *name)
+{
+        fprintf(stderr, "Usage: %s [-a addr] [-n count] port[,port...] "
+                        "[select|poll|epoll|vmin|uring ...]\n"
+                        "       %s [-a addr] [-n count] -s ports "
+                        "[select|poll|epoll|vmin|uring ...]\n",
+                        name, name);
+}
+
+int main(int argc, char **argv)
+{
+        char *fnames[PORTS_MAX];
+        pid_t pids[PORTS_MAX];
+        int addr = 1, count = 100, sims = 0, ports = 0;
+        int arg_idx = 1;
+        int i, m, ret = 0;
+        char *endptr, *tok;
+
+        while (arg_idx + 1 < argc && argv[arg_idx][0] == '-') {
+                if (!strcmp(argv[arg_idx], "-a")) {
+                        addr = strtol(argv[arg_idx + 1], &endptr, 0);
+                        if (addr < SDP_DEV_ADDR_MIN ||
+                                        addr > SDP_DEV_ADDR_MAX || *endptr) {
+                                fprintf(stderr, "Device address out of range\n");
+                                return -1;
+                        }
+                } else if (!strcmp(argv[arg_idx], "-n")) {
+                        count = strtol(argv[arg_idx + 1], &endptr, 0);
+                        if (count <= 0 || *endptr) {
+                                fprintf(stderr, "Invalid count\n");
+                                return -1;
+                        }
+                } else if (!strcmp(argv[arg_idx], "-s")) {
+                        sims = strtol(argv[arg_idx + 1], &endptr, 0);
+                        if (sims <= 0 || sims > PORTS_MAX || *endptr) {
+                                fprintf(stderr, "Invalid number of ports\n");
+                                return -1;
+                        }
+                } else {
+                        usage(argv[0]);
+                        return -1;
+                }
+                arg_idx += 2;
+        }
+
+        if (sims) {
+                signal(SIGCHLD, SIG_DFL);
+                for (ports = 0; ports < sims; ports++) {
+                        fnames[ports] = sim_start(&pids[ports]);
+                        if (!fnames[ports]) {
+                                perror("Failed to start simulator");
+                                ret = -1;
+                                goto out;
+                        }
+                }
+        } else {
+                if (arg_idx >= argc) {
+                        usage(argv[0]);
+                        return -1;
+                }
+                for (tok = strtok(argv[arg_idx++], ","); tok;
+                                tok = strtok(NULL, ",")) {
+                        if (ports == PORTS_MAX) {
+                                fprintf(stderr, "Too many ports\n");
+                                return -1;
+                        }
+                        fnames[ports++] = tok;
+                }
+        }
+
+        printf("%-8s %6s %6s %8s %8s %8s %8s %8s %8s\n", "method", "frames",
+                        "errors", "wakeups", "syscalls", "cpu[us]",
+                        "avg[us]", "min[us]", "max[us]");
+
+        /* no method selected, test all */
+        if (arg_idx == argc) {
+                for (m = 0; m < METHOD_COUNT; m++)
+                        if ( (ret = bench(fnames, ports, addr, m, count)) < 0)
+                                goto out;
+                goto out;
+        }
+
+        for (i = arg_idx; i < argc; i++) {
+                for (m = 0; m < METHOD_COUNT; m++)
+                        if (!strcmp(argv[i], method_names[m]))
+                                break;
+                if (m == METHOD_COUNT) {
+                        usage(argv[0]);
+                        ret = -1;
+                        goto out;
+                }
+                if ( (ret = bench(fnames, ports, addr, m, count)) < 0)
+                        goto out;
+        }
+
+out:
+        if (sims) {
+                for (i = 0; i < ports; i++) {
+                        kill(pids[i], SIGTERM);
+                        waitpid(pids[i], NULL, 0);
+                        free(fnames[i]);
+                }
+        }
+
+        return ret;
+}
@@ -0,0 +1,572 @@
+/*
+ * The sdp2xxx project.
+ * Copyright (C) 2011  Jiří Pinkava
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ * */
+
+/*
+ * Daemon owning serial ports of SDP power supplies. It keeps ports open and
+ * remote session of devices established and serves clients over Unix
+ * socket, see msdp2xxx_msdpd.h for protocol. Requests of all clients and
+ * ports are processed by one sdp_loop_t. Optionally readings requested by
+ * clients are published to shared memory, see msdp2xxx_shm.h.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msdp2xxx.h"
+#include "msdp2xxx_low.h"
+
+#ifndef __linux__
+#error "Unsupported OS"
+#endif
+
+#include "msdp2xxx_loop.h"
+#include "msdp2xxx_msdpd.h"
+#include "msdp2xxx_shm.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** Maximal number of events processed by one epoll_wait call. */
+#define EVENTS_MAX (64)
+
+/**
+ * Serial port owned by daemon.
+ */
+typedef struct {
+        /** opened port */
+        sdp_t sdp;
+        /** name of port given on command line */
+        const char *name;
+        /** resolved name of port, used to match client requests */
+        char path[PATH_MAX];
+        /** bit for each RS485 address with open remote session */
+        unsigned long sess;
+        /** shared memory slot of each RS485 address, -1 when not known */
+        int shm_slot[SDP_DEV_ADDR_MAX + 1];
+} port_t;
+
+/**
+ * Client connected to daemon.
+ */
+typedef struct {
+        /** connection */
+        int fd;
+        /** port selected by hello message, NULL before hello */
+        port_t *port;
+        /** request in progress and its sequence number */
+        sdp_req_t req;
+        uint32_t seq;
+        /** 1 while req is submitted */
+        int busy;
+        /** 1 when client disconnected while req was submitted */
+        int closed;
+} client_t;
+
+static sdp_loop_t loop;
+static int epfd = -1;
+static port_t *ports;
+static int port_count;
+static sdp_shm_t shm;
+static volatile sig_atomic_t stop;
+/* epoll tags of non-client descriptors */
+static int tag_listen, tag_loop;
+
+static void sig_stop(int sig)
+{
+        stop = 1;
+}
+
+/**
+ * Get RS485 address from command prepared by sdp_s* function.
+ * @param cmd   Command.
+ * @param len   Lenght of command.
+ * @return      Address, 0 when command does not contain valid address.
+ */
+static int cmd_addr(const char *cmd, int len)
+{
+        int addr;
+
+        if (len < 6 || cmd[4] < '0' || cmd[4] > '9' ||
+                        cmd[5] < '0' || cmd[5] > '9')
+                return 0;
+        addr = (cmd[4] - '0') * 10 + cmd[5] - '0';
+        if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX)
+                return 0;
+
+        return addr;
+}
+
+/**
+ * Send answer to client.
+ * @param cl    Client.
+ * @param ret   Lenght of response, or negative number (error no.).
+ * @param err   Value of errno when ret is SDP_EERRNO.
+ * @param resp  Response of device.
+ */
+static void client_reply(client_t *cl, int ret, int err, const char *resp)
+{
+        sdp_msdpd_hdr_t hdr;
+        struct iovec iov[2];
+        struct msghdr msg;
+
+        hdr.seq = cl->seq;
+        hdr.ret = ret;
+        hdr.err = (ret < 0) ? err : 0;
+        iov[0].iov_base = &hdr;
+        iov[0].iov_len = sizeof(hdr);
+        iov[1].iov_base = (char *)resp;
+        iov[1].iov_len = (ret > 0) ? ret : 0;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        /* client waits for answer, failure means it is gone */
+        sendmsg(cl->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+/**
+ * Set events client connection is waited for.
+ * @param cl    Client.
+ * @param events        EPOLLIN, or 0 while request is in progress.
+ */
+static void client_events(client_t *cl, unsigned int events)
+{
+        struct epoll_event ev;
+
+        ev.events = events;
+        ev.data.ptr = cl;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, cl->fd, &ev);
+}
+
+/**
+ * Disconnect client, client is freed once its request is completed.
+ * @param cl    Client.
+ */
+static void client_close(client_t *cl)
+{
+        epoll_ctl(epfd, EPOLL_CTL_DEL, cl->fd, NULL);
+        close(cl->fd);
+        cl->fd = -1;
+        if (cl->busy)
+                cl->closed = 1;
+        else
+                free(cl);
+}
+
+/**
+ * Publish reading recieved by client request to shared memory.
+ * @param port  Port request was send to.
+ * @param addr  RS485 address of device.
+ * @param req   Completed request.
+ */
+static void publish(port_t *port, int addr, sdp_req_t *req)
+{
+        sdp_lcd_info_raw_t lcd_info_raw;
+        sdp_shm_data_t data;
+        unsigned int part;
+        int ret;
+
+        switch (sdp_op_id(req->cmd, req->cmd_len)) {
+        case sdp_op_getd:
+                part = SDP_SHM_VA_DATA;
+                ret = sdp_resp_va_data(req->resp, req->ret, &data.va_data);
+                break;
+        case sdp_op_gets:
+                part = SDP_SHM_SETPOINT;
+                ret = sdp_resp_va_setpoint(req->resp, req->ret,
+                                &data.setpoint);
+                break;
+        case sdp_op_gpal:
+                part = SDP_SHM_LCD_INFO;
+                ret = sdp_resp_lcd_info(req->resp, req->ret, &lcd_info_raw);
+                if (ret >= 0)
+                        sdp_lcd_to_data(&data.lcd_info, &lcd_info_raw);
+                break;
+        default:
+                return;
+        }
+        if (ret < 0)
+                return;
+
+        if (port->shm_slot[addr] < 0)
+                port->shm_slot[addr] = sdp_shm_slot(&shm, port->name, addr);
+        if (port->shm_slot[addr] >= 0)
+                sdp_shm_publish(&shm, port->shm_slot[addr], &data, part);
+}
+
+/**
+ * Completion callback of client request.
+ * @param req   Completed request.
+ */
+static void client_done(sdp_req_t *req)
+{
+        client_t *cl = req->priv;
+        int addr = cmd_addr(req->cmd, req->cmd_len);
+
+        if (sdp_op_id(req->cmd, req->cmd_len) == sdp_op_sess && req->ret >= 0)
+                cl->port->sess |= 1ul << addr;
+        /* device might be restarted, establish session again */
+        if (req->ret == SDP_ETIMEDOUT)
+                cl->port->sess &= ~(1ul << addr);
+        if (shm.hdr && addr && req->ret > 0)
+                publish(cl->port, addr, req);
+
+        cl->busy = 0;
+        if (cl->closed) {
+                free(cl);
+                return;
+        }
+        client_reply(cl, req->ret, req->err, req->resp);
+        client_events(cl, EPOLLIN);
+}
+
+/**
+ * Process hello message of client.
+ * @param cl    Client.
+ */
+static void client_hello(client_t *cl)
+{
+        sdp_msdpd_hello_t hello;
+        char path[PATH_MAX];
+        ssize_t n;
+        int idx;
+
+        n = recv(cl->fd, &hello, sizeof(hello), MSG_DONTWAIT);
+        if (n < 0 && errno == EAGAIN)
+                return;
+        if (n != sizeof(hello) || hello.magic != SDP_MSDPD_MAGIC) {
+                client_close(cl);
+                return;
+        }
+
+        hello.port[sizeof(hello.port) - 1] = 0;
+        if (!realpath(hello.port, path))
+                strcpy(path, hello.port);
+        for (idx = 0; idx < port_count; idx++) {
+                if (!strcmp(ports[idx].path, path))
+                        break;
+        }
+        if (idx == port_count) {
+                client_reply(cl, SDP_EERRNO, ENODEV, NULL);
+                client_close(cl);
+                return;
+        }
+
+        cl->port = &ports[idx];
+        client_reply(cl, 0, 0, NULL);
+}
+
+/**
+ * Process command recieved from client.
+ * @param cl    Client.
+ */
+static void client_cmd(client_t *cl)
+{
+        sdp_req_t *req = &cl->req;
+        sdp_msdpd_req_t hdr;
+        struct iovec iov[2];
+        struct msghdr msg;
+        sdp_op_t op;
+        ssize_t n;
+        int addr, ret;
+
+        iov[0].iov_base = &hdr;
+        iov[0].iov_len = sizeof(hdr);
+        iov[1].iov_base = req->cmd;
+        iov[1].iov_len = sizeof(req->cmd);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+
+        n = recvmsg(cl->fd, &msg, MSG_DONTWAIT);
+        if (n < 0 && errno == EAGAIN)
+                return;
+        if (n <= (ssize_t)sizeof(hdr)) {
+                client_close(cl);
+                return;
+        }
+        cl->seq = hdr.seq;
+        if (msg.msg_flags & MSG_TRUNC) {
+                client_reply(cl, SDP_ETOLARGE, ERANGE, NULL);
+                return;
+        }
+        req->cmd_len = n - sizeof(hdr);
+
+        op = sdp_op_id(req->cmd, req->cmd_len);
+        addr = cmd_addr(req->cmd, req->cmd_len);
+        /* session is kept open by daemon */
+        if ((op == sdp_op_sess && (cl->port->sess & (1ul << addr))) ||
+                        op == sdp_op_ends) {
+                client_reply(cl, 3, 0, "OK\r");
+                return;
+        }
+
+        req->cb = client_done;
+        req->priv = cl;
+        cl->busy = 1;
+        client_events(cl, 0);
+        ret = sdp_loop_submit(&loop, &cl->port->sdp, req);
+        if (ret < 0) {
+                cl->busy = 0;
+                client_reply(cl, ret, errno, NULL);
+                client_events(cl, EPOLLIN);
+        }
+}
+
+/**
+ * Accept new client.
+ * @param lfd   Listening socket.
+ */
+static void client_accept(int lfd)
+{
+        struct epoll_event ev;
+        client_t *cl;
+        int fd;
+
+        fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+                return;
+        cl = calloc(1, sizeof(*cl));
+        if (!cl) {
+                close(fd);
+                return;
+        }
+        cl->fd = fd;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = cl;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                free(cl);
+        }
+}
+
+/**
+ * Create listening socket, stale socket of terminated daemon is replaced.
+ * @param path  Path of socket.
+ * @return      Socket, -1 on error.
+ */
+static int listen_sock(const char *path)
+{
+        struct sockaddr_un sa;
+        int fd;
+
+        if (strlen(path) >= sizeof(sa.sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        strcpy(sa.sun_path, path);
+
+        fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0);
+        if (fd < 0)
+                return -1;
+        if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
+                close(fd);
+                errno = EADDRINUSE;
+                return -1;
+        }
+        unlink(path);
+        if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+                        listen(fd, SOMAXCONN) < 0) {
+                close(fd);
+                return -1;
+        }
+
+        return fd;
+}
+
+/**
+ * Close remote sessions and ports.
+ */
+static void ports_close(void)
+{
+        int idx, addr;
+
+        for (idx = 0; idx < port_count; idx++) {
+                port_t *port = &ports[idx];
+
+                sdp_loop_del(&loop, &port->sdp);
+                for (addr = SDP_DEV_ADDR_MIN; addr <= SDP_DEV_ADDR_MAX;
+                                addr++) {
+                        if (!(port->sess & (1ul << addr)))
+                                continue;
+                        port->sdp.addr = addr;
+                        sdp_remote(&port->sdp, 0);
+                }
+                sdp_close(&port->sdp);
+        }
+}
+
+static void usage(const char *name)
+{
+        fprintf(stderr, "Usage: %s [-s socket] [-m shm] port [port ...]\n"
+                        "        -m - publish readings to shared memory, "
+                        "use \"-\" for " SDP_SHM_NAME "\n", name);
+}
+
+int main(int argc, char **argv)
+{
+        const char *sock = NULL, *shm_name = NULL;
+        char sock_path[PATH_MAX];
+        struct epoll_event ev[EVENTS_MAX];
+        struct sigaction sa;
+        int arg_idx = 1;
+        int lfd, idx, n, ret;
+
+        while (arg_idx + 1 < argc && argv[arg_idx][0] == '-') {
+                if (!strcmp(argv[arg_idx], "-s")) {
+                        sock = argv[arg_idx + 1];
+                } else if (!strcmp(argv[arg_idx], "-m")) {
+                        shm_name = argv[arg_idx + 1];
+                        if (!strcmp(shm_name, "-"))
+                                shm_name = SDP_SHM_NAME;
+                } else {
+                        break;
+                }
+                arg_idx += 2;
+        }
+        if (arg_idx >= argc || argv[arg_idx][0] == '-') {
+                usage(argv[0]);
+                return -1;
+        }
+        if (!sock) {
+                if (sdp_msdpd_socket(sock_path, sizeof(sock_path)) < 0) {
+                        perror("Invalid socket path");
+                        return -1;
+                }
+                sock = sock_path;
+        }
+
+        if (sdp_loop_init(&loop) < 0) {
+                perror("sdp_loop_init failed");
+                return -1;
+        }
+
+        ports = calloc(argc - arg_idx, sizeof(*ports));
+        if (!ports) {
+                perror("Out of memory");
+                return -1;
+        }
+        for (; arg_idx < argc; arg_idx++) {
+                port_t *port = &ports[port_count];
+                sdp_open_opts_t opts = {
+                        .flags = SDP_OPEN_LOW_LATENCY | SDP_OPEN_FLUSH |
+                                SDP_OPEN_EXCL,
+                };
+
+                port->name = argv[arg_idx];
+                memset(port->shm_slot, -1, sizeof(port->shm_slot));
+                if (!realpath(port->name, port->path))
+                        strcpy(port->path, port->name);
+                ret = sdp_open_ex(&port->sdp, port->name, SDP_DEV_ADDR_MIN,
+                                &opts);
+                if (ret < 0) {
+                        fprintf(stderr, "Failed to open %s: %s\n", port->name,
+                                        sdp_strerror(ret));
+                        goto err;
+                }
+                port_count++;
+                if (sdp_loop_add(&loop, &port->sdp) < 0) {
+                        perror("sdp_loop_add failed");
+                        goto err;
+                }
+        }
+
+        /* readings might be read by other users */
+        if (shm_name && sdp_shm_create(&shm, shm_name,
+                                port_count * SDP_DEV_ADDR_MAX, 0644) < 0) {
+                perror("Failed to create shared memory");
+                goto err;
+        }
+
+        lfd = listen_sock(sock);
+        if (lfd < 0) {
+                perror("Failed to create socket");
+                goto err;
+        }
+
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (epfd < 0) {
+                perror("epoll_create1 failed");
+                goto err_sock;
+        }
+        ev[0].events = EPOLLIN;
+        ev[0].data.ptr = &tag_listen;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev[0]);
+        /* events of ports are processed by sdp_loop_run */
+        ev[0].events = EPOLLIN;
+        ev[0].data.ptr = &tag_loop;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, loop.epfd, &ev[0]);
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = sig_stop;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        while (!stop) {
+                n = epoll_wait(epfd, ev, EVENTS_MAX, sdp_loop_timeout(&loop));
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        perror("epoll_wait failed");
+                        break;
+                }
+                for (idx = 0; idx < n; idx++) {
+                        client_t *cl = ev[idx].data.ptr;
+
+                        if (ev[idx].data.ptr == &tag_listen) {
+                                client_accept(lfd);
+                        } else if (ev[idx].data.ptr == &tag_loop) {
+                                continue;
+                        } else if (ev[idx].events & (EPOLLERR | EPOLLHUP)) {
+                                client_close(cl);
+                        } else if (!cl->port) {
+                                client_hello(cl);
+                        } else {
+                                client_cmd(cl);
+                        }
+                }
+                /* recieve responses and expire timeouts */
+                sdp_loop_run(&loop, 0);
+        }
+
+        /* let requests in progress complete, clients are not served */
+        while (loop.pending)
+                sdp_loop_run(&loop, -1);
+
+        close(epfd);
+err_sock:
+        close(lfd);
+        unlink(sock);
+err:
+        ports_close();
+        sdp_loop_close(&loop);
+        sdp_shm_close(&shm);
+        free(ports);
+
+        return stop ? 0 : -1;
+}
@@ -21,6 +21,9 @@
 #include <string.h>
 #include "msdp2xxx.h"
 #ifdef __linux__
+#include "msdp2xxx_msdpd.h"
+#include "msdp2xxx_lease.h"
+#include <fcntl.h>
 #include <unistd.h>
 #define TEXT(s) (s)
 #define _TCHAR char
@@ -86,10 +89,12 @@ static int printe(const char *str)
  */
 static void print_help(void)
 {
-        printf("sdptool [-h] [-a <addr>] <io port> <CMD>\n"
+        printf("sdptool [-h] [-a <addr>] [-l <sec>] <io port> <CMD>\n"
         "        -h - print help\n"
         "        -a - set device address\n"
         "        <addr>  - rs485 address of device (1 - 31), defaults to 1\n"
+        "        -l - keep remote session for <sec> seconds, calls within\n"
+        "             lease do not send SESS and ENDS (Linux only)\n"
         "        <io port> - port for comunication with SDP power supply\n"
         "                win: { COM1 | COM2 | ... }\n"
         "                Linux: { /dev/ttyS0 | /dev/ttyS1 | ... }\n"
@@ -115,7 +120,8 @@ static void print_help(void)
         "                prop { 0 - 19 } { 0 - 99.9 } { 0 - 9.99 } { 00:00 - 99:59 | 0 -  5999 } |\n"
         "                runm { 1 - 9 } |\n"
         "                runp { 1 - 999 | inf } |\n"
-        "                stop }\n"
+        "                stop |\n"
+        "                ends } - end remote session kept by -l\n"
         "        See SDP power supply manual for detailed informations about commands\n");
 }
 
@@ -129,14 +135,54 @@ static void print_help_short(void)
                         
 }
 
+#ifdef __linux__
+/**
+ * Start background process which sends ENDS when lease lapses.
+ * @param port  Name of port.
+ */
+static void lease_reaper(const char *port)
+{
+        pid_t pid;
+        int fd;
+
+        fflush(NULL);
+        pid = fork();
+        if (pid != 0)
+                return;
+
+        /* do not hold output of caller open, shell would wait for it */
+        setsid();
+        fd = open("/dev/null", O_RDWR);
+        if (fd >= 0) {
+                dup2(fd, STDIN_FILENO);
+                dup2(fd, STDOUT_FILENO);
+                dup2(fd, STDERR_FILENO);
+                if (fd > STDERR_FILENO)
+                        close(fd);
+        }
+        _exit(sdp_lease_reap(port) < 0);
+}
+#endif
+
 int main(int argc, char **argv_)
 {
         int addr = 1;
         int arg_idx = 1;
+        long lease_ttl = 0;
+        int sess = 1;
+#ifdef __linux__
+        const char *port = NULL;
+        sdp_lease_t lease;
+        /* -1 when lease is not used */
+        int leased = -1;
+#endif
 	const _TCHAR *cmd;
         FILE *f_stdout;
         int ret;
         sdp_t sdp;
+        sdp_open_opts_t opts = {
+                .flags = SDP_OPEN_LOW_LATENCY | SDP_OPEN_FLUSH | SDP_OPEN_EXCL,
+        };
 
 #ifdef _WIN32
 	wchar_t **argv;
@@ -161,16 +207,26 @@ int main(int argc, char **argv_)
                 return printe("Invalid or missing argument");
         }
 
-        if (!strcmp(argv[1], TEXT("-a"))) {
+        for (;;) {
                 _TCHAR *endptr;
 
-                if (argc < 5)
-                        return printe("Invalid or missing argument");
-                addr = strtol(argv[2], &endptr, 0);
-                if (addr < SDP_DEV_ADDR_MIN || addr > SDP_DEV_ADDR_MAX ||
-                                *endptr)
-                        return printe("Device address out of range");
-                arg_idx = 3;
+                if (!strcmp(argv[arg_idx], TEXT("-a"))) {
+                        if (argc < arg_idx + 4)
+                                return printe("Invalid or missing argument");
+                        addr = strtol(argv[arg_idx + 1], &endptr, 0);
+                        if (addr < SDP_DEV_ADDR_MIN ||
+                                        addr > SDP_DEV_ADDR_MAX || *endptr)
+                                return printe("Device address out of range");
+                } else if (!strcmp(argv[arg_idx], TEXT("-l"))) {
+                        if (argc < arg_idx + 4)
+                                return printe("Invalid or missing argument");
+                        lease_ttl = strtol(argv[arg_idx + 1], &endptr, 0);
+                        if (lease_ttl < 0 || lease_ttl > 86400 || *endptr)
+                                return printe("Lease out of range");
+                } else {
+                        break;
+                }
+                arg_idx += 2;
         }
 
 #ifdef __linux__
@@ -184,8 +240,16 @@ int main(int argc, char **argv_)
                 f_stdout = stderr;
         }
         else {
-
-                ret = sdp_open(&sdp, argv[arg_idx], addr);
+                /* use msdpd when it serves the port, it keeps port open
+                 * and remote session established */
+                ret = sdp_msdpd_open(&sdp, NULL, argv[arg_idx], addr);
+                if (ret < 0) {
+                        /* lease is locked before port is used, it
+                         * serializes msdptool calls on the port */
+                        port = argv[arg_idx];
+                        leased = sdp_lease_lock(&lease, port, addr);
+                        ret = sdp_open_ex(&sdp, port, addr, &opts);
+                }
                 if (ret < 0)
                         return perror_("sdp_open failed", ret);
                 f_stdout = stdout;
@@ -201,16 +265,12 @@ int main(int argc, char **argv_)
                 f_stdout = stderr;
         } 
         else {
-                ret = sdp_open(&sdp, argv[arg_idx], addr);
+                ret = sdp_open_ex(&sdp, argv[arg_idx], addr, &opts);
                 if (ret < 0)
                         return perror_("sdp_open failed", ret);
                 f_stdout = stdout;
         }
 #endif
-	ret = sdp_remote(&sdp, 1);
-	if (ret < 0)
-                return perror_("Failed to switch to remote mode", ret);
-
         // Drop already processed arguments
         arg_idx++;
 		cmd = argv[arg_idx++];
@@ -218,6 +278,20 @@ int main(int argc, char **argv_)
         argc -= arg_idx;
         arg_idx = 0;
 
+#ifdef __linux__
+        /* session is still active from previous call */
+        if (leased > 0)
+                sess = 0;
+#endif
+        if (!strcmp(cmd, TEXT("ends")))
+                sess = 0;
+        if (sess) {
+                ret = sdp_remote(&sdp, 1);
+                if (ret < 0)
+                        return perror_("Failed to switch to remote mode",
+                                        ret);
+        }
+
         if (!strcmp(cmd, TEXT("ccom"))) {
                 sdp_ifce_t ifce;
 
@@ -616,6 +690,12 @@ int main(int argc, char **argv_)
                 if (ret < 0)
                         return perror_("sdp_stop failed", ret);
         }
+        else if (!strcmp(cmd, TEXT("ends"))) {
+                if (argc != 0)
+                        return printe("Invalid number of parameters");
+
+                lease_ttl = 0;
+        }
         else {
                 print_help_short();
                 printe("Unknown command");
@@ -626,9 +706,24 @@ int main(int argc, char **argv_)
         // returning 0 / -1, this allows call
         // a) multiple commands
         // b) call this even if no success (want we call this on error?)
+#ifdef __linux__
+        if (leased >= 0 && lease_ttl) {
+                /* port must be free for reaper once lease is unlocked */
+                sdp_close(&sdp);
+                if (sdp_lease_unlock(&lease, lease_ttl * 1000000l) > 0)
+                        lease_reaper(port);
+                return 0;
+        }
+#endif
         ret = sdp_remote(&sdp, 0);
         if (ret < 0)
                 return perror_("Failed to disable remote mode", ret);
+#ifdef __linux__
+        if (leased >= 0) {
+                sdp_close(&sdp);
+                sdp_lease_unlock(&lease, 0);
+        }
+#endif
 
         return 0;
 }